@@ -0,0 +1,171 @@
+/*
+    Description: Cycle counts of the control loop's hot path on the ATmega2560.
+    Built by the bench environment and run under simavr (pio run -e bench -t simavr).
+    Each function is timed with Timer1 running at the CPU clock, with interrupts disabled,
+    and reported over Serial as min/mean/max cycles per call.
+    The pre-lookup-table deviation loop and the float PID are kept here as references.
+*/
+
+#define TELEMETRY_NO_UART // Results are printed through Serial
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <LineDetector.h>
+#include <MotorDriver.h>
+#include <PIDController.h>
+#include <ControlLoop.h>
+#include <Odometry.h>
+
+
+#define RUNS 64 // Calls timed per benchmark
+
+
+int lfrPins[] = {LFR_PINS},
+    motorPins[4][2] = {{5, 28}, {2, 22}, {3, 24}, {4, 26}};
+
+Motors motor(motorPins);
+LineDetector lfr(lfrPins);
+PIDController pid(13, 0, 5);
+PIDControllerQ16_16 pid32(13, 0, 5);
+ControlLoop control(lfr, motor, pid);
+Odometry odometry(393, 250);
+
+const MotorCalibration sampleCal = {20, 230, {0, 20, 45, 72, 100, 130, 160, 195, 235}}; // Typical measured curve
+const int errors[] = {0, 1, 3, -2, -3, 0, 6, -6}; // Inputs cycled through by the PID benchmarks
+const MotionProfile benchProfile = {192, 5}, noProfile = {0, 0}; // Ramp as on the bot; no ramp
+const byte quadrature[] = {0x00, 0x55, 0xFF, 0xAA}; // Port K as all four encoders count up; the worst case
+volatile int sink;                                  // Keeps results from being optimized away
+uint16_t overhead;                                  // Cycles taken by the timing code itself
+
+
+/**
+ * Deviation as calculated before the lookup tables: one digitalRead() and one weight per sensor
+ */
+int legacyDeviation() {
+  static const int weight[8] = {-3, -2, -1, 0, 0, 1, 2, 3};
+  int err = 0, onLine = 0;
+  for (int i = 0; i < 8; i++) {
+    if (digitalRead(lfrPins[i]) == HIGH)
+      onLine++;
+    else
+      err += weight[i];
+  }
+  sink = onLine;
+  return err;
+}
+
+/**
+ * PID step as calculated before the fixed-point controller
+ */
+struct FloatPID {
+  float kP, kI, kD;
+  int P, I, D, lastErr;
+
+  int calcVolt(int err) {
+    P = kP * err;
+    I += err;
+    D = kD * (err - lastErr);
+    int result = P + (kI * I) + D;
+    lastErr = err;
+    return (result > 0) ? result : -result;
+  }
+} floatPid = {13, 0, 5, 0, 0, 0, 0};
+
+
+/**
+ * Times RUNS calls of a statement and prints min/mean/max cycles
+ * @param name  Label printed with the result
+ * @param call  Statement to time; i is the run index
+ */
+#define BENCH(name, call)                                   \
+  do {                                                      \
+    uint16_t lo = 0xFFFF, hi = 0;                           \
+    uint32_t sum = 0;                                       \
+    for (int i = 0; i < RUNS; i++) {                        \
+      cli();                                                \
+      uint16_t start = TCNT1;                               \
+      call;                                                 \
+      uint16_t cycles = TCNT1 - start - overhead;           \
+      sei();                                                \
+      sum += cycles;                                        \
+      if (cycles < lo) lo = cycles;                         \
+      if (cycles > hi) hi = cycles;                         \
+    }                                                       \
+    report(F(name), lo, sum / RUNS, hi);                    \
+  } while (0)
+
+void report(const __FlashStringHelper *name, uint16_t lo, uint16_t mean, uint16_t hi) {
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(lo);
+  Serial.print(F(" / "));
+  Serial.print(mean);
+  Serial.print(F(" / "));
+  Serial.print(hi);
+  Serial.println(F(" cycles (min / mean / max)"));
+  Serial.flush(); // Keep the UART interrupt out of the next measurement
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  // Timer1 counts CPU cycles
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+
+  overhead = 0;
+  cli();
+  uint16_t start = TCNT1;
+  uint16_t stop = TCNT1;
+  sei();
+  overhead = stop - start;
+
+  Serial.println(F("Cycles per call at F_CPU; min / mean / max over 64 calls"));
+
+  // Sensor read and classification
+  BENCH("legacy deviation (digitalRead loop)", sink = legacyDeviation());
+  BENCH("LineDetector::readSensors", sink = lfr.readSensors());
+  BENCH("LineDetector::capture", sink = lfr.capture().deviation);
+  BENCH("LineDetector::calcDeviation", sink = lfr.calcDeviation());
+
+  // PID step
+  BENCH("float PID calcVolt", sink = floatPid.calcVolt(errors[i & 7]));
+  BENCH("PIDController (Q8.8) calcVolt", sink = pid.calcVolt(errors[i & 7]));
+  BENCH("PIDControllerQ16_16 calcVolt", sink = pid32.calcVolt(errors[i & 7]));
+
+  // Motor outputs
+  BENCH("MotorDriver::move('f')", motor.move('f', 120));
+  BENCH("MotorDriver::move('l', adjust)", motor.move('l', 40, true));
+  BENCH("MotorDriver::move('r', adjust)", motor.move(i & 1 ? 'r' : 'l', 40, true));
+  BENCH("calibratePwm", sink = calibratePwm(sampleCal, i * 4));
+  BENCH("MotorDriver::move(vx, vy, omega)", motor.move(220, errors[i & 7] * 20, 0));
+  BENCH("MotorDriver::move(vx, vy, omega) saturated", motor.move(220, 180, i & 1 ? 60 : -60));
+  BENCH("MotorDriver::turn", motor.turn(i & 1 ? 'r' : 'l'));
+  BENCH("MotorDriver::commit (no change)", motor.commit());
+  BENCH("MotorDriver::move + commit", (motor.move(i & 1 ? 'r' : 'l', 40, true), motor.commit()));
+  motor.setProfile(benchProfile);
+  BENCH("MotorDriver::tick (ramping)", (motor.move(i & 32 ? 220 : 0, 0, 0), motor.tick()));
+  motor.setProfile(noProfile);
+  motor.stop();
+  motor.commit();
+
+  // Encoders
+  BENCH("Odometry::pinChange (4 encoders)", Odometry::pinChange(quadrature[i & 3]));
+  BENCH("Odometry::pinChange + update", (Odometry::pinChange(quadrature[i & 3]), odometry.update()));
+
+  // Whole control tick
+  control.follow(80);
+  BENCH("ControlLoop::tick", control.tick());
+  motor.stop();
+  motor.commit();
+
+  // simavr exits when the CPU sleeps with interrupts disabled
+  Serial.println(F("done"));
+  Serial.flush();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  cli();
+  sleep_mode();
+}
+
+void loop() {
+}
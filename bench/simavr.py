@@ -0,0 +1,21 @@
+# Adds the `simavr` target to the bench environment:
+# prints flash/SRAM usage of the benchmark firmware and runs it under simavr,
+# which echoes the cycle counts written to Serial.
+
+Import("env")
+
+from os.path import join
+
+simavr = join(env.PioPlatform().get_package_dir("tool-simavr") or "", "bin", "simavr")
+elf = join("$BUILD_DIR", "${PROGNAME}.elf")
+
+env.AddCustomTarget(
+    name="simavr",
+    dependencies=elf,
+    actions=[
+        "$SIZETOOL --mcu=$BOARD_MCU -C -d " + elf,
+        '"%s" -m $BOARD_MCU -f $BOARD_F_CPU %s' % (simavr, elf),
+    ],
+    title="Benchmark",
+    description="Run the cycle benchmarks under simavr",
+)
@@ -0,0 +1,119 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+/*
+  Relay feedback auto-tuning of the line following PID (Astrom-Hagglund).
+  While tuning, the PID is replaced by a relay: full lateral push towards the line, switched on the sign of
+  the deviation. The bot then weaves about the line in a limit cycle. Its period Tu and amplitude a give the
+  ultimate gain Ku = 4 * relay / (pi * a), from which the gains follow by the Ziegler-Nichols rules.
+  Works on whatever ControlLoop drives, so it runs the same on the arena and in the simulator.
+*/
+
+#include <Arduino.h>
+
+
+#define TUNE_SETTLE 2   // Relay cycles ignored while the weave builds up
+#define TUNE_CYCLES 4   // Relay cycles measured
+#define TUNE_TIMEOUT 4000 // Ticks from the start or the last rising switch before tuning gives up
+
+
+class AutoTuner {
+
+private:
+  int relay,                    // Lateral output while tuning
+      out;                      // Output in use; +-relay
+  int8_t lo, hi;                // Extremes of the deviation in the current cycle
+  byte cycles;                  // Relay cycles completed
+  unsigned long startTick,      // Tick at which the run started
+                cycleStart;     // Tick at which the current cycle began; 0 until the first rising switch
+  long periodSum;               // Ticks, over the measured cycles
+  int swingSum;                 // Peak-to-peak deviation, over the measured cycles
+  bool done, failed;
+
+public:
+  AutoTuner() {
+    relay = 0;
+    done = true;
+    failed = false;
+  }
+
+  void start(int, unsigned long); // Starts a tuning run; Parameters - relay output, tick
+  int step(int, unsigned long); // Relay output for a tick; Parameters - deviation, tick
+  bool isDone() { return done; }
+  bool gains(float &, float &, float &); // Ziegler-Nichols PID gains per tick; false if the run failed
+};
+
+void AutoTuner::start(int r, unsigned long tick) {
+  relay = r;
+  out = r;
+  lo = hi = 0;
+  cycles = 0;
+  startTick = tick;
+  cycleStart = 0;
+  periodSum = 0;
+  swingSum = 0;
+  done = failed = false;
+}
+
+/**
+ * One tick of the relay
+ * A cycle ends when the relay switches back to pushing left; a zero deviation keeps the last push,
+ * which gives the relay its hysteresis
+ * @param int           error Deviation of this tick
+ * @param unsigned long tick  Control tick
+ * @return int lateral  Output to apply; positive to the left
+ */
+int AutoTuner::step(int error, unsigned long tick) {
+  if (done)
+    return 0;
+
+  if (error < lo)
+    lo = error;
+  if (error > hi)
+    hi = error;
+
+  if (out < 0 && error > 0) { // Rising switch; one full cycle since the last one
+    if (cycleStart && cycles++ >= TUNE_SETTLE) {
+      periodSum += tick - cycleStart;
+      swingSum += hi - lo;
+    }
+    cycleStart = tick;
+    lo = hi = error;
+    if (cycles >= TUNE_SETTLE + TUNE_CYCLES)
+      done = true;
+  }
+  else if (tick - (cycleStart ? cycleStart : startTick) > TUNE_TIMEOUT)
+    done = failed = true; // No oscillation; never reached the line, lost it, or the relay is too weak
+
+  if (error > 0)
+    out = relay;
+  else if (error < 0)
+    out = -relay;
+  return done ? 0 : out;
+}
+
+/**
+ * Gains from the measured limit cycle
+ * Classic Ziegler-Nichols: kP = 0.6 Ku, Ti = Tu / 2, Td = Tu / 8, with Tu in ticks
+ * @param float kP, kI, kD  Filled in
+ * @return bool tuned   False if the run did not complete
+ */
+bool AutoTuner::gains(float &kP, float &kI, float &kD) {
+  if (!done || failed || !swingSum)
+    return false;
+
+  float tu = (float)periodSum / TUNE_CYCLES,
+        a = (float)swingSum / (2 * TUNE_CYCLES),
+        ku = 4 * relay / (PI * a);
+
+  kP = 0.6f * ku;
+  kI = kP / (tu / 2);
+  kD = kP * tu / 8;
+  return true;
+}
+
+#undef TUNE_SETTLE
+#undef TUNE_CYCLES
+#undef TUNE_TIMEOUT
+
+#endif
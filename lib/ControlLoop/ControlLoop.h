@@ -0,0 +1,459 @@
+#ifndef CONTROLLOOP_H
+#define CONTROLLOOP_H
+
+/*
+  Fixed-rate line following loop.
+  Timer2 fires a compare-match interrupt at a fixed rate; every tick samples the IR array,
+  steps the PID controller and writes the motors. The PID gains are therefore tuned for a known dt.
+  The PID output drives the bot sideways while it keeps moving forward at the straight line voltage.
+  Mission code only starts a segment with follow() and waits for the cross-section event.
+  A segment may pass any number of cross-sections: they are counted on the fly (on their rising edge, so the
+  one the bot starts on does not count), and the bot only stops at the last one.
+
+  The straight line voltage adapts to the line: it ramps up while the deviation stays within a deadband
+  and backs off in proportion to the error, never going below the voltage given to follow().
+  Once a cross-section has been passed and the next one is the last of the segment, it brakes back down
+  to that voltage. With odometry, and the length of the segment given to follow(), it brakes instead when
+  the line left is what braking at the measured speed takes. Cross-sections are then told apart by distance:
+  one within CLEAR_DISTANCE of the start or of the last one counted is the same cross-section, and the last
+  one of a segment is not taken in its first three quarters.
+  PID gains are scheduled on this voltage from a table of speed bands. The table can be kept in EEPROM,
+  where the auto-tune run (tune()) leaves it.
+*/
+
+#include <Arduino.h>
+#include "GainBand.h"
+#include <LineDetector.h>
+#include <MotorDriver.h>
+#include <PIDController.h>
+#include <Telemetry.h>
+#include <Profiler.h>
+#include <AutoTuner.h>
+#include <Odometry.h>
+#include <EEPROM.h>
+
+
+#ifndef CONTROL_HZ
+#define CONTROL_HZ 1000 // Default control rate
+#endif
+
+#define MAX_BANDS 4 // Gain schedule entries
+
+#ifndef CLEAR_TICKS
+#define CLEAR_TICKS (CONTROL_HZ / 5) // Ticks after follow() in which a cross-section is the one the bot stopped on
+#endif
+#ifndef CLEAR_DISTANCE
+#define CLEAR_DISTANCE 60 // Travel (mm) after follow(), or after a cross-section, in which it is the same one, with odometry
+#endif
+#ifndef BRAKE_MARGIN
+#define BRAKE_MARGIN 120 // Line (mm) left at the segment voltage before the last cross-section, with odometry
+#endif
+
+#ifndef CONTROL_EEPROM
+#define CONTROL_EEPROM 64 // EEPROM address of the gain schedule; after the motor calibration
+#endif
+#define SCHEDULE_MAGIC 0x6A17
+
+
+// Adaptive straight line voltage
+struct SpeedProfile {
+  int maxVolt,  // Highest voltage on straights
+      rampUp,   // Increase per tick while on the line; 1/256 V
+      backOff,  // Decrease per tick per step of the digital deviation; 1/256 V
+      deadband, // Digital deviation upto which the bot counts as on the line
+      brake;    // Decrease per tick on the way to the last cross-section of a segment; 1/256 V, 0 at once
+};
+
+
+class ControlLoop {
+
+private:
+  LineDetector &lfr;
+  Motors &motor;
+  PIDController &pid;
+
+  SensorFrame frame;            // Frame sampled in the last tick
+  volatile int stdVolt;         // Voltage applied while moving straight; lowest adaptive voltage
+  long speed;                   // Adaptive straight line voltage; 1/256 V
+  SpeedProfile profile;
+
+  AutoTuner *tuner;             // Replaces the PID while tuning, if set
+  Telemetry *telemetry;         // Records a frame every logEvery ticks, if set
+  Odometry *odometry;           // Measures the travel of the segment, if set
+  byte logEvery, logCount;
+
+  PIDController::Gains gains[MAX_BANDS]; // Gain schedule, ordered by voltage
+  int bandVolt[MAX_BANDS];
+  byte bands, band;                      // Entries in the schedule; entry in use
+
+  void adaptSpeed(int);                  // Updates the straight line voltage; Parameter - deviation
+  void scheduleGains();                  // Picks the gains for the current voltage
+  void log(int);                         // Sends a telemetry record; Parameter - deviation
+  long brakeDistance();                  // Line needed to brake down to stdVolt; mm
+  static byte checksum(const GainBand[], byte); // Sum of the count and band bytes of a saved schedule
+  volatile bool following,      // Line following is active
+                reached;        // A cross-section ended the last segment
+  volatile byte junctionsLeft;  // Cross-sections upto the end of the segment
+  bool approach;                // Passed the last but one cross-section; braking to stdVolt
+  unsigned int junctionsSeen;   // Junction count of the detector at the last tick
+  unsigned int clearing;        // Ticks left in which cross-sections are not counted
+  long segmentStart,            // Odometry travel at follow(); mm
+       junctionAt;              // Travel of the segment at the last cross-section counted; mm
+  unsigned int segmentLength;   // Line from follow() to the last cross-section; mm, 0 if not known
+  volatile unsigned long ticks; // Ticks since begin()
+
+public:
+  static ControlLoop *active;   // Loop serviced by the timer interrupt
+
+  ControlLoop(LineDetector &l, Motors &m, PIDController &p) : lfr(l), motor(m), pid(p) {
+    stdVolt = 0;
+    speed = 0;
+    profile.maxVolt = 0; // Fixed speed until setSpeedProfile() is called
+    profile.rampUp = profile.backOff = profile.deadband = profile.brake = 0;
+    bands = band = 0;
+    following = reached = false;
+    junctionsLeft = 0;
+    junctionsSeen = 0;
+    clearing = 0;
+    segmentStart = junctionAt = 0;
+    segmentLength = 0;
+    approach = false;
+    ticks = 0;
+    tuner = 0;
+    telemetry = 0;
+    odometry = 0;
+    logEvery = logCount = 0;
+  }
+
+  void begin(unsigned int = CONTROL_HZ); // Starts the timer; Parameter - rate in Hz
+  void setSchedule(const GainBand[], byte); // Sets the gain schedule; Parameters - bands ordered by voltage, count
+  bool loadSchedule(const GainBand[], byte); // Sets the schedule saved in EEPROM, else the given one; false if not saved
+  void saveSchedule(const GainBand[], byte); // Saves a schedule to EEPROM
+  void setSpeedProfile(const SpeedProfile &p) { profile = p; }
+  void setTelemetry(Telemetry *t, byte every = 1) { telemetry = t; logEvery = every; } // Parameters - link, ticks per record
+  void setOdometry(Odometry *o) { odometry = o; } // Updated every tick; set before begin()
+  int getSpeed() { return speed >> 8; }  // Current straight line voltage
+  void follow(int, byte = 1, unsigned int = 0); // Starts following the line; Parameters - straight line voltage, cross-sections, length (mm)
+  void tune(int, AutoTuner &, int);      // Starts a relay tuning run; Parameters - voltage, tuner, relay output
+  bool isReached() { return reached; }   // Checks if the segment ended at its last cross-section
+  byte junctionsToGo() { return junctionsLeft; } // Cross-sections upto the end of the segment
+  void wait();                           // Waits until the segment ends
+  void tick();                           // One control step; called from the timer interrupt
+  unsigned long getTicks();              // Ticks since begin()
+};
+
+ControlLoop *ControlLoop::active = 0;
+
+/**
+ * Configures Timer2 in CTC mode to interrupt at the given rate
+ * Picks the smallest prescaler for which the compare value fits in 8 bits
+ * @param unsigned int hz Control rate
+ */
+void ControlLoop::begin(unsigned int hz) {
+  const unsigned int prescalers[] = {1, 8, 32, 64, 128, 256, 1024};
+  byte cs = 1; // Clock select bits; index + 1 into prescalers[]
+  unsigned long top = F_CPU / hz;
+  while (top > 256 && cs < 7)
+    top = F_CPU / ((unsigned long)prescalers[cs++] * hz);
+
+  active = this;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  TCCR2A = _BV(WGM21); // CTC, TOP = OCR2A
+  TCCR2B = cs;
+  TCNT2 = 0;
+  OCR2A = top - 1;
+  TIMSK2 |= _BV(OCIE2A);
+  SREG = oldSREG;
+}
+
+/**
+ * Converts the gain schedule to fixed-point once, so the interrupt only copies gains
+ * @param GainBand[] table  Bands in increasing order of voltage
+ * @param byte       n      Number of bands; extra bands are ignored
+ */
+void ControlLoop::setSchedule(const GainBand table[], byte n) {
+  if (n > MAX_BANDS)
+    n = MAX_BANDS;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  for (byte i = 0; i < n; i++) {
+    // Table gains are per step of the digital deviation; a finer deviation takes proportionally smaller ones
+    gains[i] = PIDController::makeGains(table[i].kP / LineDetector::RESOLUTION, table[i].kI / LineDetector::RESOLUTION,
+                                        table[i].kD / LineDetector::RESOLUTION);
+    bandVolt[i] = table[i].volt;
+  }
+  bands = n;
+  band = 0;
+  if (bands)
+    pid.setGains(gains[0]);
+  SREG = oldSREG;
+}
+
+/**
+ * Loads the gain schedule left in EEPROM by saveSchedule(); falls back to the defaults if there is none or its checksum fails
+ * @param GainBand[] defaults  Schedule used if none is saved
+ * @param byte       n         Number of default bands
+ * @return bool saved   True if the EEPROM schedule was used
+ */
+bool ControlLoop::loadSchedule(const GainBand defaults[], byte n) {
+  uint16_t magic;
+  byte count;
+  GainBand saved[MAX_BANDS];
+  EEPROM.get(CONTROL_EEPROM, magic);
+  EEPROM.get(CONTROL_EEPROM + sizeof(magic), count);
+
+  if (magic == SCHEDULE_MAGIC && count && count <= MAX_BANDS) {
+    EEPROM.get(CONTROL_EEPROM + sizeof(magic) + sizeof(count), saved);
+    if (EEPROM.read(CONTROL_EEPROM + sizeof(magic) + sizeof(count) + count * sizeof(GainBand)) == checksum(saved, count)) {
+      setSchedule(saved, count);
+      return true;
+    }
+  }
+
+  setSchedule(defaults, n);
+  return false;
+}
+
+void ControlLoop::saveSchedule(const GainBand table[], byte n) {
+  if (n > MAX_BANDS)
+    n = MAX_BANDS;
+
+  uint16_t magic = SCHEDULE_MAGIC;
+  EEPROM.put(CONTROL_EEPROM, magic);
+  EEPROM.put(CONTROL_EEPROM + sizeof(magic), n);
+  for (byte i = 0; i < n; i++)
+    EEPROM.put(CONTROL_EEPROM + sizeof(magic) + sizeof(n) + i * sizeof(GainBand), table[i]);
+  EEPROM.update(CONTROL_EEPROM + sizeof(magic) + sizeof(n) + n * sizeof(GainBand), checksum(table, n));
+}
+
+byte ControlLoop::checksum(const GainBand table[], byte n) {
+  const byte *p = (const byte *)table;
+  byte sum = n;
+  for (unsigned int i = 0; i < n * sizeof(GainBand); i++)
+    sum += p[i];
+  return sum;
+}
+
+/**
+ * Starts line following
+ * The timer interrupt drives the motors until the given number of cross-sections have been passed;
+ * the bot keeps following the line over all but the last one
+ * A cross-section under the array at the start, or crossed within CLEAR_TICKS (CLEAR_DISTANCE with odometry),
+ * is not counted
+ * @param int          volt       Voltage applied while moving straight
+ * @param byte         junctions  Cross-sections upto the end of the segment; at least 1
+ * @param unsigned int length     Line upto the last cross-section; mm. With odometry, braking starts from it
+ */
+void ControlLoop::follow(int volt, byte junctions, unsigned int length) {
+  uint8_t oldSREG = SREG;
+  cli();
+  stdVolt = volt;
+  speed = (long)volt << 8;
+  junctionsLeft = junctions ? junctions : 1;
+  junctionsSeen = lfr.junctions(); // The one the bot may be standing on was counted when it was reached
+  approach = false;
+  clearing = odometry ? 0 : CLEAR_TICKS; // Coasting may have left it just behind the array; reversing crosses it again
+  segmentStart = odometry ? odometry->travelled() : 0;
+  junctionAt = 0;
+  segmentLength = length;
+  tuner = 0;
+  reached = false;
+  following = true;
+  SREG = oldSREG;
+}
+
+/**
+ * Follows the line under relay control at a fixed voltage, until the tuner has measured the limit cycle
+ * Cross-sections do not end the run; the segment ends when the tuner is done
+ * @param int       volt  Forward voltage
+ * @param AutoTuner t     Tuner; its gains are read after isReached()
+ * @param int       relay Lateral output of the relay
+ */
+void ControlLoop::tune(int volt, AutoTuner &t, int relay) {
+  uint8_t oldSREG = SREG;
+  cli();
+  stdVolt = volt;
+  speed = (long)volt << 8;
+  t.start(relay, ticks);
+  tuner = &t;
+  reached = false;
+  following = true;
+  SREG = oldSREG;
+}
+
+/**
+ * Waits for the cross-section event
+ */
+void ControlLoop::wait() {
+  while (!reached)
+    yield();
+}
+
+/**
+ * One step of the control loop
+ * Samples one frame, corrects the deviation and stops the bot on a cross-section
+ * Motor outputs are written once, at the end of the tick
+ */
+void ControlLoop::tick() {
+  PROFILE_LAP(PROFILE_PERIOD);
+  PROFILE_MARK(start);
+  PROFILE_MARK(section);
+  ticks++;
+  if (odometry)
+    odometry->update();
+
+  int error = 0;
+  if (following) {
+    lfr.setSpeed(getSpeed());               // Junction filter spans the same distance at any speed
+    frame = lfr.capture();                  // One sample per tick
+    error = lfr.calcDeviation(frame);       // Calculate the deviation
+    PROFILE_SPLIT(PROFILE_SENSOR, section);
+
+    int lateral;
+    if (tuner)
+      lateral = tuner->step(error, ticks);  // Relay instead of PID; fixed speed
+    else {
+      adaptSpeed(error);
+      scheduleGains();
+      lateral = pid.calcOutput(error);      // Sideways voltage requierd to fix error; positive to the left
+    }
+    PROFILE_SPLIT(PROFILE_PID, section);
+
+    motor.move(getSpeed(), lateral, 0);     // Full speed ahead while correcting
+
+    bool junction = lfr.junctions() != junctionsSeen; // Rising edge of a cross-section
+    junctionsSeen = lfr.junctions();
+    long moved = odometry ? odometry->travelled() - segmentStart : 0;
+    if (clearing) {
+      clearing--;
+      junction = false;
+    }
+    else if (odometry && moved - junctionAt < CLEAR_DISTANCE)
+      junction = false; // Still on the one the segment started on, or the one counted last
+    else if (odometry && junction && junctionsLeft == 1 && moved < segmentLength - (segmentLength >> 2))
+      junction = false; // Too soon for the last one; glare or a tape seam
+    if (junction)
+      junctionAt = moved;
+    if (junction && junctionsLeft && --junctionsLeft == 1 && !(odometry && segmentLength))
+      approach = true;
+    if (!approach && odometry && segmentLength && moved + brakeDistance() >= segmentLength)
+      approach = true; // Measured, so it also brakes on segments with a single cross-section
+
+    if (tuner ? tuner->isDone() : junction && !junctionsLeft) {
+      motor.stop(); // Stop bot movement
+      following = false;
+      reached = true;
+      tuner = 0;
+    }
+  }
+
+  motor.tick();   // Forward speed ramps towards the last move
+  motor.commit(); // Outputs changed this tick, or by the mission since the last one
+  PROFILE_SPLIT(PROFILE_MOTOR, section);
+
+  if (telemetry && ++logCount >= logEvery) {
+    logCount = 0;
+    log(error);
+  }
+  PROFILE_SINCE(PROFILE_TICK, start);
+}
+
+/**
+ * Records the frame, PID terms and motor outputs of this tick
+ * @param int error Deviation used in this tick
+ */
+void ControlLoop::log(int error) {
+  TelemetryRecord r;
+  r.tick = ticks;
+  r.sensors = frame.raw;
+  r.deviation = error;
+  r.p = pid.getP() >> PIDController::FRACTION;
+  r.i = pid.getI() >> PIDController::FRACTION;
+  r.d = pid.getD() >> PIDController::FRACTION;
+  r.dir = 0;
+  for (byte i = 0; i < 4; i++) {
+    r.pwm[i] = motor.getPwm(i);
+    if (motor.getDir(i))
+      r.dir |= 1 << i;
+  }
+  telemetry->send(r);
+}
+
+/**
+ * Ramps the straight line voltage up while the bot is on the line, and backs off as the error grows
+ * The voltage stays between stdVolt and profile.maxVolt; after the last but one cross-section of the segment,
+ * it brakes down to stdVolt at profile.brake per tick
+ * @param int error Current deviation
+ */
+void ControlLoop::adaptSpeed(int error) {
+  if (profile.maxVolt <= stdVolt)
+    return; // Adaptation disabled
+
+  long top = (long)(approach ? stdVolt : profile.maxVolt) << 8,
+       last = speed;
+  int absErr = error < 0 ? -error : error;
+  if (absErr <= profile.deadband * LineDetector::RESOLUTION)
+    speed += profile.rampUp;
+  else
+    speed -= (long)profile.backOff * absErr / LineDetector::RESOLUTION;
+
+  if (speed > top)
+    speed = profile.brake && last - profile.brake > top ? last - profile.brake : top;
+  if (speed < (long)stdVolt << 8)
+    speed = (long)stdVolt << 8;
+}
+
+/**
+ * Line the bot covers while braking from the current voltage down to stdVolt at profile.brake per tick
+ * Speed is taken as proportional to voltage, so it falls linearly from the measured one to
+ * speed * stdVolt / volt, over (volt - stdVolt) * 256 / brake ticks. BRAKE_MARGIN is added on top.
+ * @return long distance  mm
+ */
+long ControlLoop::brakeDistance() {
+  long volt = getSpeed();
+  if (volt <= stdVolt || !profile.brake)
+    return BRAKE_MARGIN; // Nothing to brake, or braked at once
+  return ((long)odometry->getSpeed() * (volt * volt - (long)stdVolt * stdVolt) / (profile.brake * volt) >> 1) +
+         BRAKE_MARGIN;
+}
+
+/**
+ * Switches to the band of the current voltage; gains are only written when the band changes
+ */
+void ControlLoop::scheduleGains() {
+  int volt = getSpeed();
+  byte b = band;
+  while (b + 1 < bands && volt >= bandVolt[b + 1])
+    b++;
+  while (b > 0 && volt < bandVolt[b])
+    b--;
+
+  if (b != band) {
+    band = b;
+    pid.setGains(gains[band]);
+  }
+}
+
+/**
+ * Returns the number of ticks since begin()
+ */
+unsigned long ControlLoop::getTicks() {
+  uint8_t oldSREG = SREG;
+  cli();
+  unsigned long t = ticks;
+  SREG = oldSREG;
+  return t;
+}
+
+ISR(TIMER2_COMPA_vect) {
+  if (ControlLoop::active)
+    ControlLoop::active->tick();
+}
+
+#undef MAX_BANDS
+#undef SCHEDULE_MAGIC
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef GAINBAND_H
+#define GAINBAND_H
+
+/*
+  Entry of the PID gain schedule of ControlLoop.
+  Kept apart so that tools which only read or print a schedule need not pull in the control loop.
+*/
+
+
+// PID gains used from the given straight line voltage upwards; per step of the digital deviation
+struct GainBand {
+  int volt;
+  float kP, kI, kD;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef FRAMEFILTER_H
+#define FRAMEFILTER_H
+
+/*
+  k-of-n filter over the last n frames of the IR array, for all 8 sensors at once.
+  A sensor counts as on the line if it was on in at least k of the last n frames, so a single frame of
+  glare or a tape seam does not make a cross-section, and one dropped sensor does not hide it.
+  The per-sensor counts are kept bit-sliced: plane j holds bit j of the count of every sensor, so adding the
+  newest frame and removing the oldest are a few AND/XOR operations on bytes, whatever n is.
+*/
+
+#include <Arduino.h>
+
+
+#define LFR_FILTER_MAX 15 // Deepest window; counts fit in 4 planes, and the ring of 16 frames
+#define LFR_FILTER_PLANES 4
+
+
+class FrameFilter {
+
+private:
+  byte history[LFR_FILTER_MAX + 1], // Last frames; a ring
+       head,                        // Slot of the next frame
+       plane[LFR_FILTER_PLANES],    // Bit-sliced count of each sensor over the window
+       depth,                       // n
+       need;                        // k
+
+  void add(byte);               // Counts a frame in
+  void remove(byte);            // Counts a frame out
+
+public:
+  FrameFilter() {
+    memset(history, 0, sizeof(history));
+    memset(plane, 0, sizeof(plane));
+    head = 0;
+    depth = need = 1;
+  }
+
+  void setDepth(byte, byte);    // Sets n and k; Parameters - frames, frames needed
+  byte getDepth() { return depth; }
+  byte filter(byte);            // Adds a frame; returns the sensors on in k of the last n frames
+};
+
+void FrameFilter::add(byte f) {
+  byte carry = f;
+  for (byte j = 0; j < LFR_FILTER_PLANES && carry; j++) {
+    byte sum = plane[j] ^ carry;
+    carry &= plane[j];
+    plane[j] = sum;
+  }
+}
+
+void FrameFilter::remove(byte f) {
+  byte borrow = f;
+  for (byte j = 0; j < LFR_FILTER_PLANES && borrow; j++) {
+    byte diff = plane[j] ^ borrow;
+    borrow &= ~plane[j];
+    plane[j] = diff;
+  }
+}
+
+/**
+ * Changes the window; counts are rebuilt from the frames kept
+ * @param byte n  Window; 1 - LFR_FILTER_MAX frames, 1 disables the filter
+ * @param byte k  Frames a sensor must be on; 1 - n
+ */
+void FrameFilter::setDepth(byte n, byte k) {
+  n = n < 1 ? 1 : n > LFR_FILTER_MAX ? LFR_FILTER_MAX : n;
+  k = k < 1 ? 1 : k > n ? n : k;
+  need = k;
+  if (n == depth)
+    return;
+
+  depth = n;
+  memset(plane, 0, sizeof(plane));
+  for (byte i = 1; i <= n; i++)
+    add(history[(head - i) & LFR_FILTER_MAX]);
+}
+
+/**
+ * Slides the window by one frame
+ * The count of every sensor is compared with k in parallel, from the top plane down
+ * @param byte raw  Packed frame
+ * @return byte filtered  Bit i set if sensor i was on in at least k of the last n frames
+ */
+byte FrameFilter::filter(byte raw) {
+  remove(history[(head - depth) & LFR_FILTER_MAX]);
+  history[head] = raw;
+  head = (head + 1) & LFR_FILTER_MAX;
+  add(raw);
+
+  byte greater = 0, equal = 0xFF;
+  for (int8_t j = LFR_FILTER_PLANES - 1; j >= 0; j--) {
+    if (need >> j & 1)
+      equal &= plane[j];
+    else {
+      greater |= equal & plane[j];
+      equal &= ~plane[j];
+    }
+  }
+  return greater | equal;
+}
+
+#undef LFR_FILTER_PLANES
+
+#endif
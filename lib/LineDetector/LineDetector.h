@@ -1,68 +1,546 @@
 #ifndef LINEDETECTOR_H
 #define LINEDETECTOR_H
 
+/*
+  IR array (LSA08) reader.
+  The eight digital outputs are read once per control tick and classified through lookup tables.
+
+  Built with LFR_ANALOG set to an ADC channel, the deviation comes from the array's analog line position
+  output instead. The ADC converts that channel continuously; its interrupt keeps a running average,
+  and capture() turns the average into a deviation with LFR_ANALOG_FRAC fractional bits.
+  The scale and sign are those of the digital deviation, only finer; LineDetector::RESOLUTION is the number
+  of steps per digital step. Turns and cross-sections still come from the digital outputs, and so does
+  the deviation when no line, or the whole array, is seen.
+
+  Built with LFR_UART set to a baud rate, the array is read from its UART instead of pins 40 - 47.
+  The LSA08 must be in UART mode 1: it streams one byte of sensor bits per reading, in the same order as
+  the packed byte. USART1 (RX1, pin 19) receives them into a ring buffer from its interrupt; capture() takes
+  every byte received since the last tick, so a cross-section seen between ticks is still reported.
+  The Arduino Serial1 object must not be used in such builds, since it has its own receive interrupt.
+
+  Turns and cross-sections are classified on a k-of-n filtered frame (FrameFilter), while the deviation
+  uses the frame as read. With setFilter(), the window n follows the speed given to setSpeed(), so that it
+  always spans about the same distance of travel; faster runs get shorter windows and still see a junction.
+  Rising turns and cross-sections of the filtered frame are counted as junctions; one under the array when reading
+  starts does not count.
+
+  rotate() only commands the servo. The time it takes is looked up from the angle it turns through
+  (lfrServoTravel, measured for the servo in use), plus SERVO_RING for it to stop swinging. Once the travel
+  time is over, isReady() reads the array itself and ends the wait early when its reading has not
+  changed for SERVO_STEADY ms; the ring time is only waited out when the reading keeps changing.
+*/
+
 
 #include <Arduino.h>
 #include <Servo.h>
+#include "FrameFilter.h"
 
 
 #define MAX_SENSOR 8  // Total number of sensors in IR array
+#define SERVO_RING 80    // Time (ms) the array may swing about its angle after the travel
+#define SERVO_STEADY 20  // Time (ms) the reading must stay the same for the swing to count as over
+#define SERVO_STEP 30    // Degrees between the entries of lfrServoTravel
+
+#ifndef LFR_FILTER_QUARTERS
+#define LFR_FILTER_QUARTERS 3 // Fraction of the window, in quarters, a sensor must be on for; the k of k-of-n
+#endif
+
+#ifndef LFR_PINS
+#define LFR_PINS 40, 41, 42, 43, 44, 45, 46, 47  // Compile-time wiring of the IR array
+#endif
+
+// Port-level reads are only mapped for the Mega
+#if defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__)
+#define LFR_PORT_READ
+#endif
+
+
+#define LFR_COUNT 0x0F  // Info bits holding the number of on-line sensors
+#define LFR_TURN  0x10  // Info bit set if the pattern is a turn
+#define LFR_CROSS 0x20  // Info bit set if the pattern is a cross-section
+
+#ifdef LFR_ANALOG
+#ifndef LFR_ANALOG_FRAC
+#define LFR_ANALOG_FRAC 3 // Fractional bits of the analog deviation
+#endif
+#define LFR_ADC_FULL 921  // Reading at the far end of the array; the LSA08 outputs 0 - 4.5 V against 5 V
+#define LFR_ADC_NONE 980  // Readings above this mean no line
+#define LFR_ADC_AVG 3     // Running average over 2^n conversions; ~0.8 ms at 9.6 kHz
+#define LFR_RESOLUTION (1 << LFR_ANALOG_FRAC)
+#else
+#define LFR_RESOLUTION 1
+#endif
+
+#ifdef LFR_UART
+#ifdef LFR_ANALOG
+#error "LFR_UART and LFR_ANALOG select different sources for the deviation"
+#endif
+#ifndef CONTROL_HZ
+#define CONTROL_HZ 1000 // Control rate (ControlLoop.h); the ring is emptied once a tick
+#endif
+#define LFR_RX_TICK (LFR_UART / 10 / CONTROL_HZ + 1) // Readings per control tick at 10 bits each, rounded up
+// Receive ring; power of two with room for two ticks of readings, so one late tick does not overrun it
+#define LFR_RX_SIZE (2 * LFR_RX_TICK <= 16 ? 16 : 2 * LFR_RX_TICK <= 32 ? 32 : 2 * LFR_RX_TICK <= 64 ? 64 : 128)
+static_assert(2 * LFR_RX_TICK <= 128, "LFR_UART sends more readings per control tick than the receive ring holds");
+#endif
 
 
 struct IRSensor {
-  int pin,      // The pin to which the sensor is connected
-      weight;   // The weight assigned to each pin
+  int pin;      // The pin to which the sensor is connected
+};
+
+/*
+  One sample of the IR array.
+  Captured once per control tick and shared by every classifier, so all decisions in a tick see the same data.
+*/
+struct SensorFrame {
+  byte raw;         // Packed sensor byte; bit i is set if sensor i is on the line
+  int8_t deviation; // Deviation from the line
+  byte info;        // On-line count and turn/cross-section flags (LFR_COUNT, LFR_TURN, LFR_CROSS)
+};
+
+
+/*
+  Lookup tables indexed by the packed sensor byte (bit i set if sensor i is HIGH / on the line).
+  Entries are computed at compile time from the sensor weights and stored in flash,
+  so classifying a sample is a single table read instead of a loop over the sensors.
+*/
+
+static_assert(MAX_SENSOR == 8, "Lookup tables are generated for an 8 sensor array");
+
+// Weight of sensor i: -3, -2, -1, 0, 0, 1, 2, 3
+// For even sensor counts the two sensors in the middle have weight 0
+constexpr int lfrWeight(int i) {
+  return (MAX_SENSOR % 2 == 0 && i >= MAX_SENSOR / 2) ? i - MAX_SENSOR / 2
+       : (MAX_SENSOR % 2 == 0) ? i - (MAX_SENSOR / 2 - 1)
+       : i - MAX_SENSOR / 2;
+}
+
+// Sum of weights of the sensors which are off the line; mirrored swaps the weight order
+constexpr int lfrDeviation(int packed, bool mirrored = false, int i = 0) {
+  return i == MAX_SENSOR ? 0
+       : ((packed >> i) & 1 ? 0 : lfrWeight(mirrored ? MAX_SENSOR - i - 1 : i)) + lfrDeviation(packed, mirrored, i + 1);
+}
+
+constexpr int lfrMirroredDeviation(int packed) { return lfrDeviation(packed, true); }
+
+// Number of sensors on the line
+constexpr int lfrCount(int packed, int i = 0) {
+  return i == MAX_SENSOR ? 0 : ((packed >> i) & 1) + lfrCount(packed, i + 1);
+}
+
+// Set if the on-line sensors form one run starting at the first or at the last sensor
+constexpr bool lfrEndRun(int packed, int mask = (1 << MAX_SENSOR) - 1) {
+  return (packed & (packed + 1)) == 0 || ((~packed & mask) & ((~packed & mask) + 1)) == 0;
+}
+
+// Count, turn and cross-section flags of a pattern
+constexpr int lfrInfo(int packed) {
+  return lfrCount(packed) |
+         ((lfrCount(packed) > MAX_SENSOR / 2 && lfrCount(packed) < MAX_SENSOR && lfrEndRun(packed)) ? LFR_TURN : 0) |
+         (lfrCount(packed) == MAX_SENSOR ? LFR_CROSS : 0);
+}
+
+// Expands f over every packed value, 0 - 255
+#define LFR_T4(f, n)   f(n), f(n + 1), f(n + 2), f(n + 3)
+#define LFR_T16(f, n)  LFR_T4(f, n), LFR_T4(f, n + 4), LFR_T4(f, n + 8), LFR_T4(f, n + 12)
+#define LFR_T64(f, n)  LFR_T16(f, n), LFR_T16(f, n + 16), LFR_T16(f, n + 32), LFR_T16(f, n + 48)
+#define LFR_T256(f)    LFR_T64(f, 0), LFR_T64(f, 64), LFR_T64(f, 128), LFR_T64(f, 192)
+
+// Deviation for the normal and the mirrored (rotated backwards) array
+const int8_t lfrDeviationTable[2][1 << MAX_SENSOR] PROGMEM = {
+  {LFR_T256(lfrDeviation)},
+  {LFR_T256(lfrMirroredDeviation)}
+};
+
+const byte lfrInfoTable[1 << MAX_SENSOR] PROGMEM = {LFR_T256(lfrInfo)};
+
+// Time (ms) the servo takes to turn through 0, 30, ... 180 degrees; ~0.17 s/60 degrees at 6 V, loaded with the array
+const uint16_t lfrServoTravel[180 / SERVO_STEP + 1] PROGMEM = {0, 90, 175, 260, 345, 430, 515};
+
+#undef LFR_T4
+#undef LFR_T16
+#undef LFR_T64
+#undef LFR_T256
+
+#ifdef LFR_ANALOG
+// Deviation per ADC count, with 16 extra fractional bits; the array spans 2 * 7 digital steps
+constexpr long lfrAnalogScale = ((long)2 * (MAX_SENSOR - 1) << (LFR_ANALOG_FRAC + 16)) / LFR_ADC_FULL;
+#endif
+
+
+#ifdef LFR_PORT_READ
+/*
+  Compile-time pin to port mapping for the Mega (see the variant's pins_arduino.h).
+  The IR array is read with one PINx access per port, instead of a digitalRead() per sensor.
+*/
+
+constexpr int lfrWiring[] = {LFR_PINS};
+
+static_assert(sizeof(lfrWiring) / sizeof(*lfrWiring) == MAX_SENSOR, "LFR_PINS must list one pin per sensor");
+
+// Port letter of each digital pin
+constexpr char lfrPortOf(int pin) {
+  return "EEEEGEHHHHBBBBJJHHDDDDAAAAAAAACCCCCCCCDGGGLLLLLLLLBBBBFFFFFFFFKKKKKKKK"[pin];
+}
+
+// Bit mask of each digital pin within its port
+constexpr byte lfrMaskOf(int pin) {
+  return 1 << ("0145533456"   // 0 - 9
+               "4567101032"   // 10 - 19
+               "1001234567"   // 20 - 29
+               "7654321072"   // 30 - 39
+               "1076543210"   // 40 - 49
+               "3210012345"   // 50 - 59
+               "6701234567"   // 60 - 69
+               [pin] - '0');
+}
+
+// First port which differs from the port of sensor 0; same port if there is none
+constexpr char lfrSecondPort(int i = 0) {
+  return i == MAX_SENSOR ? lfrPortOf(lfrWiring[0])
+       : lfrPortOf(lfrWiring[i]) != lfrPortOf(lfrWiring[0]) ? lfrPortOf(lfrWiring[i])
+       : lfrSecondPort(i + 1);
+}
+
+#define LFR_PORT_A lfrPortOf(lfrWiring[0])
+#define LFR_PORT_B lfrSecondPort()
+
+// Checks if the whole array is spread over at most two ports
+constexpr bool lfrTwoPorts(int i = 0) {
+  return i == MAX_SENSOR ||
+         ((lfrPortOf(lfrWiring[i]) == LFR_PORT_A || lfrPortOf(lfrWiring[i]) == LFR_PORT_B) && lfrTwoPorts(i + 1));
+}
+
+/**
+ * Reads the input register of a port
+ * The port is a constant, so this folds down to a single IN/LDS instruction
+ * @param char port Port letter
+ */
+inline __attribute__((always_inline)) byte lfrReadPort(char port) {
+  switch (port) {
+    case 'A': return PINA;
+    case 'B': return PINB;
+    case 'C': return PINC;
+    case 'D': return PIND;
+    case 'E': return PINE;
+    case 'F': return PINF;
+    case 'G': return PING;
+    case 'H': return PINH;
+    case 'J': return PINJ;
+    case 'K': return PINK;
+    default:  return PINL;
+  }
+}
+
+/*
+  Packs the sensor bits from the two port snapshots; bit i is set when sensor i is HIGH.
+  Unrolled at compile time into one bit test per sensor.
+*/
+template <int I>
+struct LfrGather {
+  static inline __attribute__((always_inline)) byte bits(byte a, byte b) {
+    return (((lfrPortOf(lfrWiring[I]) == LFR_PORT_A ? a : b) & lfrMaskOf(lfrWiring[I])) ? (1 << I) : 0) |
+           LfrGather<I - 1>::bits(a, b);
+  }
 };
 
+template <>
+struct LfrGather<-1> {
+  static inline __attribute__((always_inline)) byte bits(byte, byte) { return 0; }
+};
+#endif
+
 
 class LineDetector {
 
 private:
   IRSensor sensor[MAX_SENSOR];
   Servo servo;
-  int sensorOnLine;
-  bool servoBackOdd;  // Shows if servo is rotated backwards odd number of times
+  SensorFrame frame;  // Last captured frame
+  bool servoBackOdd;  // Shows if servo is rotated backwards odd number of times; selects the mirrored table
+  bool portRead;      // Pins match LFR_PINS and can be read at port level
+  void turnServo(int);        // Turns the IR array; Parameter - degrees, positive to the left
+  unsigned long rotateStart,  // Time at which the last rotation started
+                travelTime,   // Time the servo takes to reach its angle
+                settleTime,   // Time after which it is taken as settled whatever the array reads
+                steadyStart;  // Time since which the reading has not changed; 0 if no line is seen
+  byte steadyRaw;             // Reading since steadyStart
+  FrameFilter events;         // Filters the frames turns and cross-sections are classified on
+  int filterSpan,             // Window times voltage; 0 keeps the window at 1 frame
+      voltLo, voltHi;         // Voltages for which the window is right
+  unsigned int junctionCount; // Rising turns and cross-sections
+  bool offJunction;           // Neither the filtered nor the raw frame showed a turn or cross-section since the last one
+
+#ifdef LFR_UART
+  static volatile byte rxBuf[LFR_RX_SIZE], // Readings received from the array
+                       rxHead,             // Next slot written by the interrupt
+                       rxTail;             // Next reading to parse
+  static volatile bool rxOverrun;          // The interrupt caught up with rxTail since the last parse
+  byte lastRaw;         // Last reading parsed
+
+  byte receive(byte &); // Parses pending readings; returns the latest and ORs their info bits
+#endif
+
+#ifdef LFR_ANALOG
+  static volatile uint16_t analogSum; // Running sum of conversions; 2^LFR_ADC_AVG times their average
+
+  int8_t analogDeviation(const SensorFrame &); // Deviation from the analog position, else the digital one
+#endif
 
 public:
+  static const byte RESOLUTION = LFR_RESOLUTION; // Deviation steps per step of the digital array
+
   LineDetector(int[]);   // Constructor
-  int calcDeviation();   // Calculates the deviation by which the bot is off the line
-  bool isTurn();         // Checks if the bot is on a turn
-  bool isCrossSection(); // Checks if the bot is on a cross-section
-  void rotate(char);     // Rotates the IR array
+  byte readSensors();    // Reads the whole IR array as a packed byte; bit i is sensor i
+  SensorFrame capture(); // Reads the IR array once and classifies the sample
+  int calcDeviation();   // Captures a frame and returns its deviation
+  bool isTurn();         // Checks if the last captured frame is a turn
+  bool isCrossSection(); // Checks if the last captured frame is a cross-section
+
+  // Classifiers for a given frame
+  int calcDeviation(const SensorFrame &f) { return f.deviation; }
+  bool isTurn(const SensorFrame &f) { return f.info & LFR_TURN; }
+  bool isCrossSection(const SensorFrame &f) { return f.info & LFR_CROSS; }
+  int sensorOnLine(const SensorFrame &f) { return f.info & LFR_COUNT; }
+
+  void setFilter(int);   // Scales the event filter with speed; Parameter - window (frames) times voltage, 0 for none
+  void setSpeed(int);    // Fits the filter window to the voltage
+  unsigned int junctions() { return junctionCount; } // Turns and cross-sections seen since start
+
+  void rotate(char);     // Starts rotating the IR array
+  bool isReady();        // Checks if the IR array has settled after a rotation
   void initServo(int servoPin) {
     servo.attach(servoPin);
     servo.write(90);
   }
+
+#ifdef LFR_ANALOG
+  void beginAnalog();    // Starts free-running conversions of the analog output
+  static void adcIsr() { analogSum = analogSum - (analogSum >> LFR_ADC_AVG) + ADC; }
+#endif
+
+#ifdef LFR_UART
+  void beginUart();      // Starts receiving readings on USART1
+  static void rxIsr() {
+    byte next = (rxHead + 1) & (LFR_RX_SIZE - 1);
+    if (next == rxTail)
+      rxOverrun = true; // Full; the oldest reading is overwritten and the ring reads as empty
+    rxBuf[rxHead] = UDR1;
+    rxHead = next;
+  }
+#endif
 };
 
+#ifdef LFR_UART
+volatile byte LineDetector::rxBuf[LFR_RX_SIZE], LineDetector::rxHead = 0, LineDetector::rxTail = 0;
+volatile bool LineDetector::rxOverrun = false;
+#endif
+
+#ifdef LFR_ANALOG
+volatile uint16_t LineDetector::analogSum = (uint16_t)LFR_ADC_FULL / 2 << LFR_ADC_AVG; // Centred until sampled
+#endif
+
 /**
  * Constructor
- * Assigns sensor pin and weight
+ * Assigns sensor pins; weights are built into the lookup tables
  * @param int[] pins  The pins to which the IR array is connected
  * @param int   servo Pin to which the IR servo is connected
  */
 LineDetector::LineDetector(int pins[]) {
-  sensorOnLine = 0;
+  frame.raw = 0;
+  frame.deviation = 0;
+  frame.info = 0;
   servoBackOdd = false;
+  rotateStart = travelTime = settleTime = steadyStart = 0;
+  steadyRaw = 0;
+  filterSpan = 0;
+  junctionCount = 0;
+  offJunction = false; // A junction under the array at start is not counted
+
+#ifdef LFR_UART
+  lastRaw = 0;
+#endif
 
   // Assigning pins to each sensor
   for (int i = 0; i < MAX_SENSOR; i++)
   {
     sensor[i].pin = pins[i];
-    pinMode(sensor[i].pin, INPUT);
+#ifndef LFR_UART
+    pinMode(sensor[i].pin, INPUT); // Free for other uses when the array is read over UART
+#endif
   }
 
-  // Assigning weight to each sensor
-  // -3, -2, -1, 0, 0, 1, 2, 3
-  int even = !(MAX_SENSOR % 2);                                 // Checking if total sensors are even or odd
-  int value = even ? -(MAX_SENSOR / 2 - 1) : -(MAX_SENSOR / 2); //Minimum weight
-  for (int i = 0; i < MAX_SENSOR; i++, value++) {
-    if (even && i == MAX_SENSOR / 2)
-      // Additional condition for even sensors
-      // Two sensors in middle should have weight = 0
-      value--;
-    sensor[i].weight = value; //Adding weight to each sensor
+  // Port-level reads are only valid for the compile-time wiring
+  portRead = false;
+#ifdef LFR_PORT_READ
+  portRead = lfrTwoPorts();
+  for (int i = 0; i < MAX_SENSOR; i++)
+    if (sensor[i].pin != lfrWiring[i])
+      portRead = false;
+#endif
+}
+
+/**
+ * Reads all the sensors at once
+ * Uses one or two PINx reads when the pins share ports, else falls back to digitalRead()
+ * Over UART, this is the latest reading received
+ * @return byte packed  Bit i is set if sensor i is HIGH
+ */
+byte LineDetector::readSensors() {
+#ifdef LFR_UART
+  byte info;
+  return receive(info);
+#else
+#ifdef LFR_PORT_READ
+  if (portRead) {
+    byte a = lfrReadPort(LFR_PORT_A),
+         b = lfrReadPort(LFR_PORT_B);
+    return LfrGather<MAX_SENSOR - 1>::bits(a, b);
   }
+#endif
+
+  byte packed = 0;
+  for (int i = 0; i < MAX_SENSOR; i++)
+    if (digitalRead(sensor[i].pin) == HIGH)
+      packed |= 1 << i;
+  return packed;
+#endif
+}
+
+/**
+ * Takes a single snapshot of the IR array
+ * Deviation and on-line count come from the sample; turn and cross-section flags from the filtered frames
+ * @return SensorFrame f  The captured frame
+ */
+SensorFrame LineDetector::capture() {
+#ifdef LFR_UART
+  byte seen;
+  frame.raw = receive(seen);
+#else
+  frame.raw = readSensors();
+#endif
+  byte flags = pgm_read_byte(&lfrInfoTable[events.filter(frame.raw)]);
+#ifdef LFR_UART
+  if (events.getDepth() == 1)
+    flags |= seen & (LFR_TURN | LFR_CROSS); // Unfiltered; readings between ticks count too
+#endif
+
+  frame.deviation = pgm_read_byte(&lfrDeviationTable[servoBackOdd][frame.raw]);
+  frame.info = (pgm_read_byte(&lfrInfoTable[frame.raw]) & LFR_COUNT) | (flags & (LFR_TURN | LFR_CROSS));
+  if (!(frame.info & (LFR_TURN | LFR_CROSS))) {
+    if ((flags & LFR_COUNT) < MAX_SENSOR / 2 && !(pgm_read_byte(&lfrInfoTable[frame.raw]) & (LFR_TURN | LFR_CROSS)))
+      offJunction = true; // Clear of the last junction; a junction fading out of the filter, or one the filter is warming up to, is not
+  }
+  else if (offJunction) {
+    offJunction = false;
+    junctionCount++;
+  }
+#ifdef LFR_ANALOG
+  frame.deviation = analogDeviation(frame);
+#endif
+  return frame;
+}
+
+#ifdef LFR_UART
+/**
+ * Starts USART1 at LFR_UART baud, 8N1, receiver only, with the receive interrupt
+ */
+void LineDetector::beginUart() {
+  UBRR1 = (F_CPU / 8 + LFR_UART / 2) / LFR_UART - 1;
+  UCSR1A = _BV(U2X1);
+  UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);
+  UCSR1B = _BV(RXEN1) | _BV(RXCIE1);
+}
+
+/**
+ * Takes the readings received since the last call
+ * Each one is classified on the way, so events between ticks are not lost.
+ * After an overrun the ring holds readings from more than a tick ago, out of order; only the latest is taken
+ * @param byte seen   Info bits of every reading taken, ORed together
+ * @return byte raw   Latest reading; the last one again if nothing arrived
+ */
+byte LineDetector::receive(byte &seen) {
+  byte head = rxHead; // Single byte; read atomically
+  if (rxOverrun) {
+    rxOverrun = false;
+    rxTail = head;
+    lastRaw = rxBuf[(head - 1) & (LFR_RX_SIZE - 1)];
+    seen = pgm_read_byte(&lfrInfoTable[lastRaw]);
+    return lastRaw;
+  }
+
+  seen = 0;
+  while (rxTail != head) {
+    lastRaw = rxBuf[rxTail];
+    rxTail = (rxTail + 1) & (LFR_RX_SIZE - 1);
+    seen |= pgm_read_byte(&lfrInfoTable[lastRaw]);
+  }
+  return lastRaw;
+}
+#endif
+
+#ifdef LFR_ANALOG
+/**
+ * Starts the ADC on channel LFR_ANALOG in free-running mode
+ * ADC clock is F_CPU / 128 (125 kHz at 16 MHz); a conversion completes every 13 clocks
+ */
+void LineDetector::beginAnalog() {
+  ADMUX = _BV(REFS0) | (LFR_ANALOG & 0x07);               // AVCC reference, right adjusted
+  ADCSRB = LFR_ANALOG & 0x08 ? _BV(MUX5) : 0;              // Free-running trigger
+  ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+/**
+ * Converts the averaged analog position to a deviation
+ * The deviation is in 1/RESOLUTION steps of the digital deviation, with the same sign
+ * @param SensorFrame f Digital frame of the same tick
+ * @return int8_t deviation
+ */
+int8_t LineDetector::analogDeviation(const SensorFrame &f) {
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t reading = analogSum >> LFR_ADC_AVG;
+  SREG = oldSREG;
+
+  // No line, or a cross-section where the position means nothing
+  if (!(f.info & LFR_COUNT) || (f.info & LFR_CROSS) || reading > LFR_ADC_NONE)
+    return f.deviation * RESOLUTION;
+
+  if (reading > LFR_ADC_FULL)
+    reading = LFR_ADC_FULL; // Past the far end
+  int offset = LFR_ADC_FULL / 2 - (int)reading; // Positive towards sensor 0
+  int deviation = ((long)offset * lfrAnalogScale) >> 16;
+  return servoBackOdd ? -deviation : deviation;
+}
+#endif
+
+/**
+ * Makes the event filter window span a fixed distance of travel
+ * @param int span  Window in frames times the straight line voltage; 0 turns the filter off
+ */
+void LineDetector::setFilter(int span) {
+  filterSpan = span;
+  voltLo = 1;
+  voltHi = 0; // Window is refitted on the next setSpeed()
+  if (!span)
+    events.setDepth(1, 1);
+}
+
+/**
+ * Fits the window to the voltage; n = span / volt, and k is LFR_FILTER_QUARTERS of n rounded up
+ * Only divides when the voltage leaves the range the current window was fitted for
+ * @param int volt  Straight line voltage
+ */
+void LineDetector::setSpeed(int volt) {
+  if (!filterSpan || (volt >= voltLo && volt <= voltHi))
+    return;
+
+  int n = volt > 0 ? filterSpan / volt : LFR_FILTER_MAX;
+  n = n < 1 ? 1 : n > LFR_FILTER_MAX ? LFR_FILTER_MAX : n;
+  voltLo = n == LFR_FILTER_MAX ? 0 : filterSpan / (n + 1) + 1;
+  voltHi = n == 1 ? 0x7FFF : filterSpan / n;
+  events.setDepth(n, (n * LFR_FILTER_QUARTERS + 3) / 4);
 }
 
 /**
@@ -70,39 +548,16 @@ LineDetector::LineDetector(int pins[]) {
    * @return int err  The positive or negative deviation  
    */
 int LineDetector::calcDeviation() {
-  sensorOnLine = 0; // Reset number of on-line sensors
-  int err = 0;
-  for (int i = 0; i < MAX_SENSOR; i++) {
-    byte readValue = digitalRead(sensor[i].pin);
-    if (readValue == HIGH)
-      // Current IR sensor is on the white line
-      sensorOnLine++;
-    else
-      // Add weights off sensors which are off line
-      err += sensor[i].weight;
-  }
-  return err;
-
+  return calcDeviation(capture());
 }
 
 /**
    * Checks if the bot is on a right-angled turn
+   * Half or more of the sensors must be on the line in one run from either end of the array, but not all of them
    * @return bool result  Boolean status
    */
 bool LineDetector::isTurn() {
-  int contOnLine = 0; // Total continuous sensors which are on line
-  for (int i = 0; i < MAX_SENSOR; i++) {
-    if(digitalRead(sensor[i].pin) == LOW)
-      contOnLine++;
-    else
-      contOnLine = 0;
-  }
-  if(contOnLine >= MAX_SENSOR/2 - 1 && contOnLine < MAX_SENSOR)
-    // contOnLine >= MAX_SENSOR/2 - 1   Half or more sensors must be on line for it to be a turn
-    // contOnLine < MAX_SENSOR          Required to check that it's not a cross section
-    return true;
-  else
-    return false;
+  return isTurn(frame);
 }
 
 /**
@@ -111,47 +566,113 @@ bool LineDetector::isTurn() {
    * Then bot is at a cross-section
    */
 bool LineDetector::isCrossSection() {
-  if (sensorOnLine == MAX_SENSOR)
-    // All sensors are on-line
-    return true;
-  else
-    return false;
+  return isCrossSection(frame);
 }
 
 
 /**
  * Rotates the servo to which the IR array is attached.
- * Depending on how many times the rotate funciton is called (even/odd), the command for left or right direction is altered.
+ * The array turns with the bot, whether it faces the way of travel or, after an odd number of 'b', away from it.
+ * Does not wait for the servo; check isReady() before following the line.
  * @param char dir  Direction of rotation
  */
 void LineDetector::rotate(char dir) {
+  rotateStart = millis();
+  travelTime = settleTime = steadyStart = 0;
+
   switch (dir) {
     case 'l':
-      if(servoBackOdd)
-        servo.write(servo.read() - 90);
-      else
-        servo.write(servo.read() + 90);
+      turnServo(90);
       break;
     case 'r':
-      if(servoBackOdd)
-        servo.write(servo.read() + 90);
-      else
-        servo.write(servo.read() - 90);
+      turnServo(-90);
       break;
     case 'b':
-      // Instead of rotating the servo, reverse the order of assigned weight
-      for (int i = 0; i <= MAX_SENSOR/2; i++) {
-        int temp = sensor[i].weight;
-        sensor[i].weight = sensor[MAX_SENSOR - i - 1].weight;
-        sensor[MAX_SENSOR - i - 1].weight = temp;
-      }
-      servoBackOdd = !servoBackOdd; // Toggle value
+      // Instead of rotating the servo, switch to the mirrored deviation table
+      servoBackOdd = !servoBackOdd; // Toggle value; servo does not move
       break;
   }
+}
+
+/**
+ * Turns the servo by the given angle
+ * An angle past the end of its travel is reached the other way round: facing the opposite direction,
+ * the array lies the same but reversed, which the mirrored table undoes
+ * @param int delta Degrees; positive to the left
+ */
+void LineDetector::turnServo(int delta) {
+  int from = servo.read(),
+      angle = from + delta;
+  if (angle < 0 || angle > 180) {
+    angle += angle < 0 ? 180 : -180;
+    servoBackOdd = !servoBackOdd;
+  }
+  servo.write(angle);
 
-  delay(500); // Time required to adjust the Servo
+  // Travel time, interpolated between the measured angles
+  byte travel = angle > from ? angle - from : from - angle,
+       k = travel / SERVO_STEP, f = travel % SERVO_STEP;
+  uint16_t t = pgm_read_word(&lfrServoTravel[k]);
+  if (f)
+    t += (pgm_read_word(&lfrServoTravel[k + 1]) - t) * f / SERVO_STEP;
+  travelTime = t;
+  settleTime = travel ? t + SERVO_RING : 0;
 }
 
+/**
+ * Checks if the servo has settled after the last rotation
+ * Before the travel time is over it cannot have. After it, the same reading for SERVO_STEADY ends the wait;
+ * while the array swings, the lines under it move from sensor to sensor. Without any line under the array
+ * nothing shows the swing, so SERVO_RING past the travel is waited out.
+ * Reads the array, so it must not be polled while the control loop is following the line.
+ * @return bool result  Boolean status
+ */
+bool LineDetector::isReady() {
+  unsigned long now = millis(), since = now - rotateStart;
+  if (since >= settleTime)
+    return true;
+  if (since < travelTime)
+    return false;
+
+  byte raw = readSensors();
+  if (!raw)
+    steadyStart = 0;
+  else if (!steadyStart || raw != steadyRaw) {
+    steadyStart = now | 1; // 0 means no line
+    steadyRaw = raw;
+  }
+  else if (now - steadyStart >= SERVO_STEADY) {
+    settleTime = 0; // Settled; stays ready until the next rotation
+    return true;
+  }
+  return false;
+}
+
+#ifdef LFR_ANALOG
+ISR(ADC_vect) {
+  LineDetector::adcIsr();
+}
+#endif
+
+#ifdef LFR_UART
+ISR(USART1_RX_vect) {
+  LineDetector::rxIsr();
+}
+#endif
+
 #undef MAX_SENSOR
+#undef SERVO_RING
+#undef SERVO_STEADY
+#undef SERVO_STEP
+#undef LFR_ADC_FULL
+#undef LFR_ADC_NONE
+#undef LFR_ADC_AVG
+#undef LFR_RESOLUTION
+#undef LFR_RX_TICK
+#undef LFR_RX_SIZE
+#undef LFR_FILTER_MAX
+#undef LFR_FILTER_QUARTERS
+#undef LFR_PORT_A
+#undef LFR_PORT_B
 
 #endif
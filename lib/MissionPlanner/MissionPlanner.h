@@ -0,0 +1,194 @@
+#ifndef MISSIONPLANNER_H
+#define MISSIONPLANNER_H
+
+/*
+  Picks the throwing zone for each shuttle from the match time left.
+  Every throwing zone has an expected value per throw (its points times the chance of scoring), a loading point
+  and, optionally, a limit on throws and a zone which must have been thrown from first.
+  The time of every route is estimated from its length and turns, and then learnt from the routes the bot drives.
+  A throw cycle is the route from the zone to its loading point and back, plus the throw.
+  pick() tries each zone the rules allow next: its first throw from where the bot is, then the rest of the match
+  filled greedily with the zones of the best value per second, as many cycles of each as fit. The zone with the
+  most expected points wins. A few multiplies and at most one division per zone and candidate; no search over time.
+*/
+
+#include <Arduino.h>
+#include <RoutePlanner.h>
+
+
+#define MAX_THROW_ZONES 4  // Throwing zones planned for
+#ifndef PLAN_SPEED
+#define PLAN_SPEED 500     // Mean speed (mm/s) over a route, turns aside; first guess until the route is driven
+#endif
+#ifndef PLAN_TURN_TIME
+#define PLAN_TURN_TIME 500 // Time (ms) a quarter turn takes; first guess
+#endif
+#define PLAN_LEARN 2       // Each driven route moves its estimate 1/2^PLAN_LEARN of the way to the time taken
+
+
+struct ThrowZone {
+  byte zone,      // Node of the throwing zone
+       loading,   // Zone its shuttle is handed over at
+       value,     // Expected points per throw; points times the chance of scoring
+       limit,     // Most throws allowed; 0 for no limit
+       needs;     // Index of the zone which must be thrown from first; its own index for none
+};
+
+
+class MissionPlanner {
+
+private:
+  RoutePlanner &route;
+  const ThrowZone *zones;
+  byte count;
+  byte throws[MAX_THROW_ZONES];                     // Throws made from each zone
+  unsigned int estimate[ROUTE_ZONES][ROUTE_ZONES];  // Route times; ms
+  unsigned long matchEnd;                           // millis() at which the match ends
+  unsigned int throwTime;                           // Time (ms) the bot waits at a zone to throw
+
+  long cycle(byte);             // Time of a throw cycle from a zone's loading point; Parameter - zone index
+  long fill(long, byte[]);      // Expected points of the rest of the match; Parameters - time, throws made so far
+  bool allowed(byte, byte[]);   // Checks the rules for a throw; Parameters - zone index, throws made so far
+
+public:
+  MissionPlanner(RoutePlanner &r) : route(r) {
+    count = 0;
+    matchEnd = 0;
+    throwTime = 0;
+  }
+
+  void begin(const ThrowZone[], byte, unsigned long, unsigned int); // Parameters - zones, count, match length (ms), throw time (ms)
+  void measured(byte, byte, unsigned long); // Learns a route time; Parameters - from, to, time (ms)
+  void thrown(byte i) { throws[i]++; }      // Counts a throw; Parameter - zone index
+  long timeLeft();                          // Match time left; ms, never below 0
+  int pick(byte);                           // Zone index of the next throw; Parameter - zone the bot is at
+};
+
+/**
+ * Starts the match clock and makes the first guess of every route time
+ * @param ThrowZone[]   z      Throwing zones; zones a zone needs come before it
+ * @param byte          n      Number of zones; upto MAX_THROW_ZONES
+ * @param unsigned long match  Match length; ms
+ * @param unsigned int  wait   Time the bot stays at a zone to throw; ms
+ */
+void MissionPlanner::begin(const ThrowZone z[], byte n, unsigned long match, unsigned int wait) {
+  zones = z;
+  count = n < MAX_THROW_ZONES ? n : MAX_THROW_ZONES;
+  memset(throws, 0, sizeof(throws));
+  matchEnd = millis() + match;
+  throwTime = wait;
+
+  for (byte from = 0; from < ROUTE_ZONES; from++)
+    for (byte to = 0; to < ROUTE_ZONES; to++) {
+      unsigned long t = (unsigned long)route.distance(from, to) * 1000 / PLAN_SPEED;
+      for (byte i = 0; i < route.legs(from, to); i++) {
+        char turn = legTurn(route.leg(from, to, i));
+        if (turn == 'l' || turn == 'r')
+          t += PLAN_TURN_TIME;
+      }
+      estimate[from][to] = t < 0xFFFF ? t : 0xFFFF;
+    }
+}
+
+/**
+ * Moves the estimate of a route towards the time it took
+ * @param byte          from, to  The route
+ * @param unsigned long ms        Time from the start of its first leg to the end of its last
+ */
+void MissionPlanner::measured(byte from, byte to, unsigned long ms) {
+  long t = ms < 0xFFFF ? ms : 0xFFFF;
+  estimate[from][to] += (t - (long)estimate[from][to]) >> PLAN_LEARN;
+}
+
+long MissionPlanner::timeLeft() {
+  long left = (long)(matchEnd - millis());
+  return left > 0 ? left : 0;
+}
+
+long MissionPlanner::cycle(byte i) {
+  const ThrowZone &z = zones[i];
+  return (long)estimate[z.zone][z.loading] + estimate[z.loading][z.zone] + throwTime;
+}
+
+bool MissionPlanner::allowed(byte i, byte made[]) {
+  const ThrowZone &z = zones[i];
+  return (!z.limit || made[i] < z.limit) && (z.needs == i || made[z.needs]);
+}
+
+/**
+ * Greedy plan for the rest of the match
+ * Takes the allowed zone with the most points per second that still fits, as many cycles of it as fit and the
+ * rules allow, and repeats with the time left. Cycles are counted from the zone's own loading point.
+ * @param long   left  Time left after the throws already planned; ms
+ * @param byte[] made  Throws made, and planned; updated
+ * @return long points  Expected points of the throws that fit
+ */
+long MissionPlanner::fill(long left, byte made[]) {
+  long points = 0;
+  bool used[MAX_THROW_ZONES] = {false};
+
+  while (true) {
+    int best = -1;
+    long bestCycle = 0;
+    for (byte i = 0; i < count; i++) {
+      long c = cycle(i);
+      if (used[i] || !allowed(i, made) || c > left)
+        continue;
+      // value / cycle, compared without dividing
+      if (best < 0 || (long)zones[i].value * bestCycle > (long)zones[best].value * c) {
+        best = i;
+        bestCycle = c;
+      }
+    }
+    if (best < 0)
+      return points;
+
+    long n = left / bestCycle;
+    if (zones[best].limit && n > zones[best].limit - made[best])
+      n = zones[best].limit - made[best];
+    used[best] = true;
+    made[best] += n;
+    left -= n * bestCycle;
+    points += n * zones[best].value;
+  }
+}
+
+/**
+ * Picks the zone of the next throw
+ * Each allowed zone is tried as the next throw, from where the bot is; the rest of the match is filled greedily.
+ * When no throw fits in the time left, the one which ends soonest is picked; the bot keeps trying.
+ * @param byte here  Zone the bot is at
+ * @return int zone  Index into the zones; -1 if the rules allow none
+ */
+int MissionPlanner::pick(byte here) {
+  long left = timeLeft(), bestPoints = -1, soonest = 0;
+  int best = -1, quickest = -1;
+
+  for (byte i = 0; i < count; i++) {
+    if (!allowed(i, throws))
+      continue;
+    const ThrowZone &z = zones[i];
+    long first = (long)estimate[here][z.loading] + estimate[z.loading][z.zone] + throwTime;
+    if (quickest < 0 || first < soonest) {
+      quickest = i;
+      soonest = first;
+    }
+    if (first > left)
+      continue;
+
+    byte made[MAX_THROW_ZONES];
+    memcpy(made, throws, sizeof(made));
+    made[i]++;
+    long points = z.value + fill(left - first, made);
+    // On a tie the bigger throw goes first; if the estimates run late, less is lost at the end
+    if (points > bestPoints || (points == bestPoints && z.value > zones[best].value)) {
+      best = i;
+      bestPoints = points;
+    }
+  }
+  return best >= 0 ? best : quickest;
+}
+
+#undef PLAN_LEARN
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef MOTIONPROFILE_H
+#define MOTIONPROFILE_H
+
+/*
+  Jerk-limited velocity ramps.
+  A step in the commanded voltage spins the omni wheels up faster than they grip, and a step down lets the
+  base slide on. A ramp moves the voltage towards its target by at most accel per tick, and changes that
+  acceleration by at most jerk per tick, so the speed follows an S-curve: the acceleration builds up, holds,
+  and eases off so that the target is reached with none left. jerk 0 gives a plain trapezoid.
+  Fixed point; a step is a few additions and two multiplies, with no division.
+*/
+
+#include <Arduino.h>
+
+
+// Limits of a ramp; 0 accel applies every command at once
+struct MotionProfile {
+  int accel,  // Most change of voltage per tick; 1/256 V
+      jerk;   // Most change of accel per tick; 1/256 V; 0 for no limit
+};
+
+// State of a ramped axis
+struct Ramp {
+  long v;     // Voltage; 1/256 V
+  int a;      // Change of voltage in the last tick; 1/256 V
+};
+
+/**
+ * Moves a ramp one tick towards its target
+ * The acceleration eases off once the change it still needs is what easing off at jerk would add:
+ * a^2 / (2 jerk), taken as a (a + jerk) / (2 jerk) for whole ticks
+ * @param Ramp          r       State; updated
+ * @param long          target  Voltage; 1/256 V
+ * @param MotionProfile p       Limits
+ */
+inline void rampStep(Ramp &r, long target, const MotionProfile &p) {
+  long left = target - r.v;
+  if (!left) {
+    r.a = 0;
+    return;
+  }
+
+  int dir = left > 0 ? 1 : -1,
+      a = r.a * dir;                   // Acceleration towards the target; negative if away from it
+  if (left < 0)
+    left = -left;
+
+  if (!p.jerk)
+    a = p.accel;
+  else if (a > 0 && (long)a * (a + p.jerk) >= 2L * p.jerk * left)
+    a -= p.jerk;                       // Ease off so as to arrive without acceleration
+  else if (a + p.jerk <= p.accel)
+    a += p.jerk;
+  else
+    a = p.accel;
+
+  if (a < 1)
+    a = 1;                             // Never stall short of the target
+  if (a >= left) {
+    r.v = target;
+    r.a = 0;
+  }
+  else {
+    r.v += (long)a * dir;
+    r.a = a * dir;
+  }
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef MOTORCALIBRATION_H
+#define MOTORCALIBRATION_H
+
+/*
+  Per-motor PWM calibration.
+  No two motors start at the same duty or reach the same speed, so the same PWM on the left and right
+  motors makes the bot drift. Each motor gets:
+    deadband - duty below which it does not turn; commands start right above it
+    gain     - scales every motor down to the top speed of the slowest one; 256 = 1
+    curve    - duty above the deadband that gives k/8 of the motor's top speed
+  so that a command of c gives c/255 of the common top speed on every motor.
+  Applying it takes a fixed number of steps per write; building it (from a PWM sweep) uses float and runs once.
+*/
+
+#include <Arduino.h>
+
+
+#define CAL_POINTS 9    // Curve points, at commands 0, 32, ... 256
+#define CAL_STEPS 33    // Sweep points, at PWM 0, 8, ... 248, 255
+
+struct MotorCalibration {
+  uint8_t deadband;
+  uint16_t gain;
+  uint8_t curve[CAL_POINTS];
+};
+
+// No correction
+#define MOTOR_CAL_IDENTITY {0, 256, {0, 32, 64, 96, 128, 160, 192, 224, 255}}
+
+
+// PWM of sweep point i
+inline uint8_t calSweepPwm(byte i) {
+  return i < CAL_STEPS - 1 ? i * 8 : 255;
+}
+
+/**
+ * Maps a command to the duty which gives the matching speed on this motor
+ * @param MotorCalibration c    Calibration of the motor
+ * @param uint8_t          cmd  Commanded PWM
+ * @return uint8_t pwm  Duty to write; 0 stays 0
+ */
+inline uint8_t calibratePwm(const MotorCalibration &c, uint8_t cmd) {
+  if (!cmd)
+    return 0;
+
+  uint16_t s = ((uint16_t)cmd * c.gain) >> 8; // Fraction of this motor's top speed; 0 - 255
+  s += s >> 7;                                // 0 - 256, so a full command reaches the end of the curve
+  uint8_t k = s >> 5, f = s & 31;
+  int above = f ? c.curve[k] + (((c.curve[k + 1] - c.curve[k]) * f) >> 5) : c.curve[k];
+
+  above += c.deadband;
+  return above > 255 ? 255 : above;
+}
+
+/**
+ * Builds the calibration of a motor from its PWM sweep
+ * @param float[]          speed  Steady speed at each sweep point; must rise with PWM
+ * @param float            top    Common top speed; the top speed of the slowest motor
+ * @param MotorCalibration c      Filled in
+ */
+inline void buildCalibration(const float speed[CAL_STEPS], float top, MotorCalibration &c) {
+  byte first = 0; // First sweep point at which the motor turns
+  while (first < CAL_STEPS - 1 && speed[first] <= 0)
+    first++;
+
+  c.deadband = first ? calSweepPwm(first - 1) : 0;
+  float own = speed[CAL_STEPS - 1];
+  c.gain = own > top ? (uint16_t)(256 * top / own + 0.5f) : 256;
+
+  for (byte k = 0; k < CAL_POINTS; k++) {
+    float want = own * k / (CAL_POINTS - 1);
+    byte i = first;
+    while (i < CAL_STEPS - 1 && speed[i] < want)
+      i++;
+
+    float pwm; // Duty reaching the wanted speed; interpolated between sweep points
+    if (i == 0 || speed[i] <= speed[i - 1])
+      pwm = calSweepPwm(i);
+    else {
+      float lo = i > first ? speed[i - 1] : 0;
+      pwm = calSweepPwm(i - 1) + (calSweepPwm(i) - calSweepPwm(i - 1)) * (want - lo) / (speed[i] - lo);
+    }
+
+    float above = k ? pwm - c.deadband : 0;
+    c.curve[k] = above < 0 ? 0 : (uint8_t)(above + 0.5f);
+  }
+}
+
+#endif
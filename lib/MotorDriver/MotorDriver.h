@@ -1,277 +1,403 @@
 #ifndef MOTORDRIVER_H
 #define MOTORDRIVER_H
 
+/*
+    Library to control motor movement of the bot.
+    The bot is square shaped; one omni wheel per motor, each driven through a PWM and a DIR pin.
+
+    The wheel geometry is a Layout: a constexpr mixing matrix giving the speed of each motor per unit of
+    forward, left and counter-clockwise velocity (positive drives with DIR LOW).
+    PlusLayout has one motor on each side, DiagonalLayout one motor at each corner.
+    turn() re-orients the bot by a multiple of 90 degrees; the four rotations of the matrix are built
+    at compile time, so turn() only picks one and move() is the same multiply-add for every orientation.
+
+    Plus layout, initial motor orientation:
+                    --------------------------------------
+                    |          Motor 1 (Right)           |
+                    |         -------------------        |
+                    |         |       |         |        |
+    Line            |         |       | Throwing|        |
+    ================| Motor 0 |       | Arm     | Motor 2|   Starting zone
+                    | (Front) |       |         | (Back) |
+                    |         |       V         |        |
+                    |         -------------------        |
+                    |          Motor 3 (Left)            |
+                    --------------------------------------
+    Diagonal layout: motors 0 - 3 are front-left, front-right, back-right and back-left.
+
+    Motor outputs are buffered in shadow registers.
+    move(), stop() and turn() only update the shadow copy; commit() writes the pins whose value changed,
+    all four motors together. ControlLoop commits once per tick, so a tick costs at most one write per changed pin.
+    Each PWM write goes through the motor's calibration (MotorCalibration.h), so equal commands give equal speeds.
+    Calibrations are kept in EEPROM; calibrate() measures them with any speed source (encoders on the bench,
+    the wheel model in the simulator).
+
+    With setProfile(), move() only sets the target of the forward and rotation velocities; tick() ramps them
+    towards it along jerk-limited S-curves (MotionProfile.h), once per control tick. The lateral velocity is the
+    line following correction, so it is applied at once. stop() is immediate; it is the brake at a cross-section.
+    Define MOTOR_LAYOUT to the layout of the bot (default PlusLayout); Motors is the driver for it.
+*/
+
 #include <Arduino.h>
+#include <EEPROM.h>
+#include "MotorCalibration.h"
+#include "MotionProfile.h"
 
 #define MAX_MOTORS 4
 #define PWM 0
 #define DIR 1
+#define AXES 3 // Forward, left, counter-clockwise
+#define CAL_SETTLE 300 // Time (ms) a wheel gets to reach its speed during calibrate()
+#define CAL_MAGIC 0xCA1B
+
+#ifndef MOTOR_CAL_EEPROM
+#define MOTOR_CAL_EEPROM 0 // EEPROM address of the calibration
+#endif
+
+
+// One motor on each side: front and back drive sideways, right and left drive forward
+struct PlusLayout {
+    static constexpr int8_t coef(byte m, byte axis) {
+        return axis == 2 ? (m < 2 ? 1 : -1)         // Front and right push counter-clockwise
+             : axis == (m & 1 ? 0 : 1) ? 1 : 0;
+    }
+};
+
+// One motor at each corner, at 45 degrees; all four share every motion
+struct DiagonalLayout {
+    static constexpr int8_t coef(byte m, byte axis) {
+        return axis == 0 ? (m == 0 || m == 3 ? 1 : -1)
+             : axis == 1 ? (m < 2 ? -1 : 1)
+             : -1;
+    }
+};
+
+#ifndef MOTOR_LAYOUT
+#define MOTOR_LAYOUT PlusLayout
+#endif
 
+/**
+ * Coefficient of a motor after the bot is turned right o times
+ * The logical velocity (vx, vy) is rotated clockwise by o * 90 degrees into the frame of the motors
+ */
+template <class Layout>
+constexpr int8_t motorMix(byte o, byte m, byte axis) {
+    return axis == 2 ? Layout::coef(m, 2)
+         : axis == 0 ? (o == 0 ? Layout::coef(m, 0) : o == 1 ? -Layout::coef(m, 1) : o == 2 ? -Layout::coef(m, 0) : Layout::coef(m, 1))
+         : (o == 0 ? Layout::coef(m, 1) : o == 1 ? Layout::coef(m, 0) : o == 2 ? -Layout::coef(m, 1) : -Layout::coef(m, 0));
+}
 
+#define MOTOR_M(o, m) {motorMix<Layout>(o, m, 0), motorMix<Layout>(o, m, 1), motorMix<Layout>(o, m, 2)}
+#define MOTOR_O(o) {MOTOR_M(o, 0), MOTOR_M(o, 1), MOTOR_M(o, 2), MOTOR_M(o, 3)}
+
+
+template <class Layout>
 class MotorDriver {
 private:
-  int motors[MAX_MOTORS][2],        // motor > index > (pwm | dir | brk)
-      lagVolt[MAX_MOTORS][2],                   // Lag applied at left(0) and front(1) motors
-      front, right, back, left,     // Direction indices
-      arr_dir[2],                   // Direction status of the left-right and front-back motors, respectively
-      lastMove;                     // Variable stores the dir variable passed to move() function
+    static constexpr int8_t mix[4][MAX_MOTORS][AXES] = {MOTOR_O(0), MOTOR_O(1), MOTOR_O(2), MOTOR_O(3)};
+
+    int motors[MAX_MOTORS][2];      // motor > index > (pwm | dir)
+    MotorCalibration cal[MAX_MOTORS];
+    byte orientation;               // Right turns since turn('f'); index into mix[]
+    int vx, vy, omega;              // Velocity on the motors
+    int tx, tw;                     // Forward and rotation velocity of the last move; vx and omega ramp towards them
+    MotionProfile profile;
+    Ramp forward, rotation;         // Ramps of vx and omega
 
-  void revDir(int);                 // Reverse the direction of motor; Parameter - motor index
-  void setDir();                    // Re-initialized arr_dir; Writes the new direction to the motor
+    byte pwmOut[MAX_MOTORS],        // Shadow PWM and DIR of each motor
+         dirOut[MAX_MOTORS];
+    int pwmHw[MAX_MOTORS],          // Values last written to the pins; -1 forces a write
+        dirHw[MAX_MOTORS];
+    volatile byte updating;         // Non-zero while the shadow is being changed; commit() skips
+
+    static byte checksum(const MotorCalibration []);
+    void apply();                   // Mixes vx, vy and omega onto the shadow outputs
 
 public:
-    MotorDriver(int [][2], int [][2]); // Constructor; Parameters - motor pins and lag voltage
-    void move(char, int, bool = false);     // Moves the bot; Parameters - direction, voltage and adjust value
+    MotorDriver(int [][2]);         // Constructor; Parameter - motor pins
+    void move(char, int, bool = false); // Moves the bot; Parameters - direction, voltage and adjust value
+    void move(int, int, int);       // Moves the bot along a vector; Parameters - forward, left and counter-clockwise velocity
     void stop();                    // Stop bot's movement
-    void stop(int, int);
     void turn(char);                // Turn bot; Parameter - direction
-    int applyLag(int);              // Returns lag to be applied to the pin
+    void setProfile(const MotionProfile &p) { profile = p; } // Ramps forward and rotation velocity; accel 0 for none
+    void tick();                    // Steps the ramps; call once per control tick
+    void commit();                  // Writes the changed outputs to the pins
+    byte getPwm(int m) { return pwmOut[m]; } // Shadow PWM of a motor
+    byte getDir(int m) { return dirOut[m]; } // Shadow DIR of a motor
+
+    void setCalibration(int m, const MotorCalibration &c) { cal[m] = c; }
+    const MotorCalibration &getCalibration(int m) { return cal[m]; }
+    bool loadCalibration(const MotorCalibration []); // From EEPROM, else the defaults; Parameter - defaults in PROGMEM
+    void saveCalibration();         // Stores the calibration in EEPROM
+    void calibrate(float (*)(int)); // Measures every motor and saves the result; Parameter - steady speed of a motor
 };
 
+template <class Layout>
+constexpr int8_t MotorDriver<Layout>::mix[4][MAX_MOTORS][AXES];
+
+typedef MotorDriver<PlusLayout> PlusMotorDriver;
+typedef MotorDriver<DiagonalLayout> DiagonalMotorDriver;
+typedef MotorDriver<MOTOR_LAYOUT> Motors; // Driver of this bot
+
 /**
  * Contructor
- * Initializes motors[][3] and lagVolt[] arrays
- * Also sets the initial direction and lastMove
- * @param int[][3] m   Motor pins
- * @param int[]    lag Lag voltage for left and front motors
+ * Initializes motors[][2]; all motors stopped with DIR LOW and uncalibrated
+ * @param int[][2] m   Motor pins
  */
-MotorDriver::MotorDriver(int m[][2], int lag[][2]) {
-    // Assiging pins to motors[][3] array
+template <class Layout>
+MotorDriver<Layout>::MotorDriver(int m[][2]) {
     for (int i = 0; i < MAX_MOTORS; i++)
         for (int j = 0; j < 2; j++) {
             motors[i][j] = m[i][j];
             pinMode(motors[i][j], OUTPUT);
-
-            if (j == 1) {
-                // Setting direction
-                digitalWrite(motors[i][j], LOW);
-            }
         }
-    // Setting lag
-    for (int i = 0; i < MAX_MOTORS; i++)
-        for(int j = 0; j < 2; j++)
-            lagVolt[i][j] = lag[i][j];
-
-    // Initializing direction variables
-    front = 0;
-    right = 1;
-    back = 2;
-    left = 3;
-
-    // Iinitializing directions[] array
-    for (int i = 0; i < 2; i++)
-        arr_dir[i] = LOW;
-    
-    // Initial move
-    lastMove = 'f';
-}
 
-/**
- * Reverse the direction of motors with the given index
- * @param int index_m Index of motor
- */
-void MotorDriver::revDir(int index_m) {
-    int direction;  // New direction - Opposite of the current value
-
-    if(index_m == front || index_m == back) {
-        arr_dir[0] = direction = !arr_dir[0]; // Updating direction
-        digitalWrite(motors[front][DIR], arr_dir[0]);
-        digitalWrite(motors[back][DIR], arr_dir[0]);
-    } 
-    else { // For left or right
-        arr_dir[1] = direction = !arr_dir[1]; // Updating direction
-        digitalWrite(motors[left][DIR], arr_dir[1]);
-        digitalWrite(motors[right][DIR], arr_dir[1]);
-    }
-}
-
-/**
- * Re-initializes arr_dir[] array based on the value of front index
- * Also, writes these values to the motors
- */
-void MotorDriver::setDir() {
-    if (front == 0) {                   // Front facing (everything is set to default)
-        for(int i = 0; i < 2; i++)
-            arr_dir[i] = LOW;           // Reset
-    }
-
-    else if (front == 1) {              // Right facing (forward <----> backward)
-        arr_dir[0] = LOW;               // For front and back motors
-        arr_dir[1] = HIGH;              // For left and right motors
-    }
-
-    else if (front == 2) {              // Back facing (forward <----> backward and left <----> right)
-        for (int i = 0; i < 2; i++)
-            arr_dir[i] = HIGH;          // All reversed
+    for (int i = 0; i < MAX_MOTORS; i++) {
+        digitalWrite(motors[i][DIR], LOW);
+        pwmOut[i] = dirOut[i] = LOW;
+        pwmHw[i] = -1; // PWM state is unknown until the first commit
+        dirHw[i] = LOW;
     }
+    updating = 0;
 
-    else {                              // Left facing (left <----> right)
-        arr_dir[0] = HIGH;              // For front and back motors
-        arr_dir[1] = LOW;              // For left and right motors
-    }
+    const MotorCalibration identity = MOTOR_CAL_IDENTITY;
+    for (int i = 0; i < MAX_MOTORS; i++)
+        cal[i] = identity;
 
-    for (int i = 0; i < MAX_MOTORS; i++) {
-        if(i == front || i == back)
-            digitalWrite(motors[i][DIR], arr_dir[0]);
-        else    // For left and right motors
-            digitalWrite(motors[i][DIR], arr_dir[1]);
-    }
+    orientation = 0;
+    vx = vy = omega = tx = tw = 0;
+    profile.accel = profile.jerk = 0;
+    forward.v = rotation.v = 0;
+    forward.a = rotation.a = 0;
 }
 
 /**
  * Moves the bot in required direction
  * @param char dir    The direction in which the bot is supposed to move
  * @param int  volt   The voltage to be written
- * @param bool adjust Adjusting status; If enabled, adjacent motors won't stop
+ * @param bool adjust Adjusting status; If enabled, a sideways move keeps the forward motion
  */
-void MotorDriver::move(char dir, int volt, bool adjust) {
-    if (lastMove != dir) // Only if the last direction and current direction isn't the same
-        switch(lastMove) {
-            // Reset the directions
-            case 'b':
-                revDir(left);
-                break;
-            case 'r':
-                revDir(front);
-                break;
-        }
-
-    switch(dir) {
+template <class Layout>
+void MotorDriver<Layout>::move(char dir, int volt, bool adjust) {
+    switch (dir) {
         case 'f':
-            stop(front, back); // Stop all other motors
-            Serial.println(motors[left][PWM]);            
-            analogWrite(motors[left][PWM], volt);   // Write signal to left motor
-            analogWrite(motors[right][PWM], volt);  // Write signal to right motor
-
-            //digitalWrite(motors[left][BRK], LOW);   // Unlock left motor
-            // digitalWrite(motors[right][BRK], LOW);  // Unlock right motor UNCOMMENT
-            
+            move(volt, 0, 0);
             break;
-        
         case 'b':
-            stop(front, back); // Stop all other motors
-
-            // No need to reverse direction if both are same
-            if (lastMove != dir) {
-                // Reverse left and right motors
-                revDir(left);
-            }
-            Serial.println(motors[left][PWM]);            
-            analogWrite(motors[left][PWM], volt);  // Write signal to left motor
-            analogWrite(motors[right][PWM], volt); // Write signal to right motor
-
-            //digitalWrite(motors[left][BRK], LOW);  // Unlock left motor
-            // digitalWrite(motors[right][BRK], LOW); // Unlock right motor UNCOMMENT
-
+            move(-volt, 0, 0);
             break;
-        
         case 'l':
-            if(!adjust) // Don't adjust
-                stop(left, right); // Stop all other motors
-
-            Serial.println(motors[front][PWM]);
-            analogWrite(motors[front][PWM], volt);  // Write signal to front motor
-            analogWrite(motors[back][PWM], volt); // Write signal to back motor
-
-            //digitalWrite(motors[front][BRK], LOW);  // Unlock front motor
-            // digitalWrite(motors[back][BRK], LOW); // Unlock back motor UNCOMMENT
-
+            move(adjust ? tx : 0, volt, 0);
             break;
-        
         case 'r':
-            if (!adjust) // Don't adjust
-                stop(left, right); // Stop all other motors
+            move(adjust ? tx : 0, -volt, 0);
+            break;
+    }
+}
 
-            // No need to reverse direction if both are same
-            if (lastMove != dir) {
-                // Reverse left and right motors
-                revDir(front);
-            }
-            analogWrite(motors[front][PWM], volt);  // Write signal to front motor
-            analogWrite(motors[back][PWM], volt); // Write signal to back motor
+/**
+ * Moves the bot along a velocity vector
+ * Without a profile the vector is applied at once; with one, forward and rotation velocity ramp towards it
+ * @param int x Forward velocity
+ * @param int y Lateral velocity; positive to the left
+ * @param int w Rotation; positive counter-clockwise
+ */
+template <class Layout>
+void MotorDriver<Layout>::move(int x, int y, int w) {
+    tx = x;
+    tw = w;
+    vy = y;
+    if (!profile.accel) {
+        vx = x;
+        omega = w;
+        forward.v = (long)x << 8; // Ramps start from here if a profile is set later
+        rotation.v = (long)w << 8;
+    }
+    apply();
+}
 
-            //digitalWrite(motors[front][BRK], LOW);  // Unlock front motor
-            // digitalWrite(motors[back][BRK], LOW); // Unlock back motor UNCOMMENT
+/**
+ * Steps the forward and rotation ramps, and mixes the new velocity onto the motors
+ * Does nothing once they have reached the last move, or without a profile
+ */
+template <class Layout>
+void MotorDriver<Layout>::tick() {
+    if (!profile.accel || (vx == tx && omega == tw))
+        return;
+
+    rampStep(forward, (long)tx << 8, profile);
+    rampStep(rotation, (long)tw << 8, profile);
+    vx = forward.v >> 8;
+    omega = rotation.v >> 8;
+    apply();
+}
 
-            break;
+/**
+ * Mixes the velocity vector onto the motors
+ * DIR of each motor follows the sign of its speed. If any motor would exceed full PWM,
+ * all are scaled down together, so the direction of motion is kept
+ */
+template <class Layout>
+void MotorDriver<Layout>::apply() {
+    const int8_t (*m)[AXES] = mix[orientation];
+    int speed[MAX_MOTORS], peak = 0;
+    for (int i = 0; i < MAX_MOTORS; i++) {
+        speed[i] = m[i][0] * vx + m[i][1] * vy + m[i][2] * omega;
+        int s = speed[i] < 0 ? -speed[i] : speed[i];
+        if (s > peak)
+            peak = s;
     }
 
-    lastMove = dir;
+    updating++;
+    for (int i = 0; i < MAX_MOTORS; i++) {
+        int s = speed[i];
+        if (peak > 255)
+            s = (long)s * 255 / peak;
+        dirOut[i] = s < 0 ? HIGH : LOW;
+        pwmOut[i] = calibratePwm(cal[i], s < 0 ? -s : s);
+    }
+    updating--;
 }
 
-void MotorDriver::turn(char dir) {
-    int temp;
-    
+/**
+ * Re-orients the bot; the motion of the last move carries on in the new frame
+ * @param char dir  'f' resets, 'r' and 'l' turn by 90 degrees, 'b' by 180
+ */
+template <class Layout>
+void MotorDriver<Layout>::turn(char dir) {
     switch (dir) {
-        case 'f':      // Reset
-            front = 0; // Motor0 will face forward
-            right = 1; // Motor1 will face right
-            back = 2;  // Motor2 will face back
-            left = 3;  // Motor3 will face left
+        case 'f':
+            orientation = 0;
+            break;
+        case 'r':
+            orientation = (orientation + 1) & 3;
             break;
         case 'b':
-            // Swap front and back
-            temp = front;
-            front = back;
-            back = temp;
-            // Swap left and right
-            temp = left;
-            left = right;
-            right = temp;
+            orientation = (orientation + 2) & 3;
             break;
         case 'l':
-            temp = front;
-            front = left; // Current left will be front
-            left = back;  // Current front will be right
-            back = right; // Current right will be back
-            right = temp; // Current back will be left
-            break;
-        case 'r':
-            temp = front;
-            front = right; // Current right will be front
-            right = back;  // Current front will be left
-            back = left;   // Current left will be back
-            left = temp;   // Current back will be right
+            orientation = (orientation + 3) & 3;
             break;
     }
 
-    setDir();
-
-    lastMove = 'f'; // Prevent unwanted direction reversal in move()
+    apply();
 }
 
 /**
  * Stop all motors
  */
-void MotorDriver::stop() {
-    for(int i = 0; i < MAX_MOTORS; i++)
-        digitalWrite(motors[i][PWM], LOW);
+template <class Layout>
+void MotorDriver<Layout>::stop() {
+    updating++;
+    vx = vy = omega = tx = tw = 0;
+    forward.v = rotation.v = 0;
+    forward.a = rotation.a = 0;
+    for (int i = 0; i < MAX_MOTORS; i++)
+        pwmOut[i] = LOW;
+    updating--;
 }
 
+
 /**
- * Function to stop specified motors
- * @param int[] x   Indices of the motors to be stopped
+ * Writes the shadow outputs to the pins
+ * Only pins whose value changed since the last commit are written; DIR goes before PWM
+ * Skipped while the shadow is being changed outside the caller, so a half-updated state is never written
  */
-void MotorDriver::stop(int m1, int m2) {
-    /*Serial.print("Stoping motors: ");
-    Serial.print(motors[m1][PWM]);
-    Serial.print(" ");    
-    Serial.println(motors[m2][PWM]);*/
-    
-    digitalWrite(motors[m1][PWM], LOW);
-    digitalWrite(motors[m2][PWM], LOW);
+template <class Layout>
+void MotorDriver<Layout>::commit() {
+    if (updating)
+        return;
+
+    for (int i = 0; i < MAX_MOTORS; i++)
+        if (dirOut[i] != dirHw[i]) {
+            digitalWrite(motors[i][DIR], dirOut[i]);
+            dirHw[i] = dirOut[i];
+        }
+
+    for (int i = 0; i < MAX_MOTORS; i++)
+        if (pwmOut[i] != pwmHw[i]) {
+            analogWrite(motors[i][PWM], pwmOut[i]);
+            pwmHw[i] = pwmOut[i];
+        }
+}
+
+template <class Layout>
+byte MotorDriver<Layout>::checksum(const MotorCalibration c[]) {
+    const byte *p = (const byte *)c;
+    byte sum = 0;
+    for (unsigned int i = 0; i < MAX_MOTORS * sizeof(MotorCalibration); i++)
+        sum += p[i];
+    return sum;
 }
 
-int MotorDriver::applyLag(int pin) {
-    for(int i = 0; i < MAX_MOTORS; i++) {
-        if(lagVolt[i][0] == pin)
-            return lagVolt[i][1];
+/**
+ * Loads the calibration saved by saveCalibration(); falls back to the defaults if there is none
+ * @param MotorCalibration[] defaults   One per motor, in PROGMEM
+ * @return bool saved   True if the EEPROM copy was used
+ */
+template <class Layout>
+bool MotorDriver<Layout>::loadCalibration(const MotorCalibration defaults[]) {
+    uint16_t magic;
+    MotorCalibration saved[MAX_MOTORS];
+    EEPROM.get(MOTOR_CAL_EEPROM, magic);
+    EEPROM.get(MOTOR_CAL_EEPROM + sizeof(magic), saved);
+
+    bool valid = magic == CAL_MAGIC && EEPROM.read(MOTOR_CAL_EEPROM + sizeof(magic) + sizeof(saved)) == checksum(saved);
+    if (valid)
+        memcpy(cal, saved, sizeof(cal));
+    else
+        memcpy_P(cal, defaults, sizeof(cal));
+    return valid;
+}
+
+template <class Layout>
+void MotorDriver<Layout>::saveCalibration() {
+    uint16_t magic = CAL_MAGIC;
+    EEPROM.put(MOTOR_CAL_EEPROM, magic);
+    EEPROM.put(MOTOR_CAL_EEPROM + sizeof(magic), cal);
+    EEPROM.update(MOTOR_CAL_EEPROM + sizeof(magic) + sizeof(cal), checksum(cal));
+}
+
+/**
+ * Sweeps the PWM of each motor in turn, DIR LOW and the others stopped, and builds the calibrations
+ * The bot must be lifted, or otherwise free to spin its wheels. Takes about 40 s.
+ * Motors are written directly, so run it before the control loop starts
+ * @param float(*)(int) speedOf Steady speed of a motor, in any unit; positive with DIR LOW
+ */
+template <class Layout>
+void MotorDriver<Layout>::calibrate(float (*speedOf)(int)) {
+    static float speed[MAX_MOTORS][CAL_STEPS]; // ~0.5 KB; only used here
+    float top = 0;
+
+    stop();
+    for (int m = 0; m < MAX_MOTORS; m++) {
+        dirOut[m] = LOW;
+        for (byte i = 0; i < CAL_STEPS; i++) {
+            pwmOut[m] = calSweepPwm(i);
+            commit();
+            delay(CAL_SETTLE);
+            speed[m][i] = speedOf(m);
+        }
+        pwmOut[m] = LOW;
+        commit();
+        delay(CAL_SETTLE);
+
+        if (m == 0 || speed[m][CAL_STEPS - 1] < top)
+            top = speed[m][CAL_STEPS - 1];
     }
-    return 0;
+
+    for (int m = 0; m < MAX_MOTORS; m++)
+        buildCalibration(speed[m], top, cal[m]);
+    saveCalibration();
 }
 
 #undef MAX_MOTORS
 #undef PWM
 #undef DIR
+#undef AXES
+#undef CAL_SETTLE
+#undef CAL_MAGIC
+#undef MOTOR_M
+#undef MOTOR_O
 
 #endif
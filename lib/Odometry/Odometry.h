@@ -0,0 +1,200 @@
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+/*
+  Dead reckoning from quadrature encoders on the four omni wheels.
+  Both channels of every encoder are on port K (PCINT16 - 23, pins A8 - A15): encoder m on PK2m (A) and PK2m+1 (B),
+  in the order of the motors (front, right, back, left). One pin change interrupt reads the port once, and every
+  encoder whose pins changed steps its count through a table of (last state, new state). Both edges of both
+  channels count, and a bounce counts up and back down. The interrupt does nothing else.
+
+  update(), once per control tick, takes the counts since the last tick and turns them into the motion of the base,
+  as in PlusLayout: the right and left wheels measure forward travel, the front and back wheels sideways travel, and
+  the difference of each pair the rotation. The pose is integrated in fixed point: position in 1/256 mm, heading as
+  a binary angle (65536 to the turn) rotated through a quarter-wave sine table. No floating point once constructed.
+  The frame is the body's own at begin(); motor.turn() re-assigns the motors, it does not turn the base.
+
+  Build with -D ODOMETRY=<wheel travel per count, um> to take the interrupt.
+*/
+
+#include <Arduino.h>
+
+
+#define ODO_WHEELS 4
+#define ODO_SPEED_AVG 2 // Speed is averaged over ~2^ODO_SPEED_AVG ticks
+
+
+// Position and heading of the base
+struct Pose {
+  long x, y;         // 1/256 mm; x ahead and y to the left of the base at begin()
+  uint16_t heading;  // Counter-clockwise; 65536 to the turn
+};
+
+// sin() of 0 - 90 degrees in 64 steps; 16384 is 1
+const uint16_t odoSine[65] PROGMEM = {
+    0, 402, 804, 1205, 1606, 2006, 2404, 2801, 3196,
+    3590, 3981, 4370, 4756, 5139, 5520, 5897, 6270, 6639,
+    7005, 7366, 7723, 8076, 8423, 8765, 9102, 9434, 9760,
+    10080, 10394, 10702, 11003, 11297, 11585, 11866, 12140, 12406,
+    12665, 12916, 13160, 13395, 13623, 13842, 14053, 14256, 14449,
+    14635, 14811, 14978, 15137, 15286, 15426, 15557, 15679, 15791,
+    15893, 15986, 16069, 16143, 16207, 16261, 16305, 16340, 16364,
+    16379, 16384
+};
+
+// Change of count from (last state << 2 | new state), states as A | B << 1; kept in RAM for the interrupt
+const int8_t odoStep[16] = {0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0};
+
+
+class Odometry {
+
+private:
+  static volatile int count[ODO_WHEELS]; // Counts of each encoder; wrap around, only differences are used
+  static volatile byte last;             // Port state the counts were last stepped from
+
+  int seen[ODO_WHEELS];       // Counts taken by the last update()
+  long step,                  // Wheel travel per count; 1/65536 mm
+       turn;                  // Heading change per count of the rotation sum; 1/65536 of the binary angle
+  Pose pose;
+  unsigned long headingFine;  // Heading with 16 extra fractional bits
+  unsigned long path;         // Travel along the path of the base; 1/256 mm
+  int speed;                  // Travel per tick; 1/256 mm, averaged
+
+  static int sine(uint16_t);  // Parameter - binary angle; returns 16384 for 1
+
+public:
+  Odometry(unsigned int, unsigned int); // Constructor; Parameters - wheel travel per count (um), centre to wheel (mm)
+  void begin();               // Takes the port and starts the pin change interrupt; the pose starts at 0
+  void update();              // Integrates the counts since the last call; once per control tick
+  Pose getPose();             // Pose since begin()
+  long travelled();           // Travel since begin(), whichever way; mm
+  int getSpeed() { return speed; } // Travel per tick; 1/256 mm. Read in the control tick
+
+  static void pinChange(byte pins) {
+    byte was = last, now = pins, changed = was ^ now;
+    last = pins;
+    for (byte m = 0; m < ODO_WHEELS; m++, was >>= 2, now >>= 2, changed >>= 2)
+      if (changed & 3)
+        count[m] += odoStep[(was & 3) << 2 | (now & 3)];
+  }
+};
+
+volatile int Odometry::count[ODO_WHEELS];
+volatile byte Odometry::last = 0;
+
+/**
+ * Constructor
+ * @param unsigned int stepUm   Wheel travel per encoder count; um
+ * @param unsigned int radius   Centre of the base to a wheel; mm
+ */
+Odometry::Odometry(unsigned int stepUm, unsigned int radius) {
+  step = ((long)stepUm << 16) / 1000;
+  // Rotation sum = 4 * radius * angle; binary angle = radians * 65536 / (2 pi)
+  turn = (long)(stepUm / 1000.0 / (4.0 * radius) * 65536 / (2 * PI) * 65536 + 0.5);
+  memset(seen, 0, sizeof(seen));
+  pose.x = pose.y = 0;
+  pose.heading = 0;
+  headingFine = 0;
+  path = 0;
+  speed = 0;
+}
+
+/**
+ * Sets port K as inputs with pull-ups, and interrupts on any change of it
+ */
+void Odometry::begin() {
+  uint8_t oldSREG = SREG;
+  cli();
+  DDRK = 0;
+  PORTK = 0xFF;
+  last = PINK;
+  for (byte m = 0; m < ODO_WHEELS; m++)
+    seen[m] = count[m];
+  PCMSK2 = 0xFF;
+  PCICR |= _BV(PCIE2);
+  SREG = oldSREG;
+}
+
+/**
+ * Sine of a binary angle, from the quarter-wave table with linear interpolation
+ * @param uint16_t a  Angle; 65536 to the turn
+ * @return int sine  16384 is 1
+ */
+int Odometry::sine(uint16_t a) {
+  uint16_t p = a & 0x3FFF;
+  if (a & 0x4000)
+    p = 0x4000 - p; // Second and fourth quarters mirror the first
+  byte i = p >> 8, f = p & 0xFF;
+  int s = pgm_read_word(&odoSine[i]);
+  if (f)
+    s += ((long)((int)pgm_read_word(&odoSine[i + 1]) - s) * f) >> 8;
+  return a & 0x8000 ? -s : s;
+}
+
+/**
+ * Moves the pose by the counts since the last call
+ * Forward travel is the mean of the right and left wheels, sideways travel that of the front and back wheels.
+ * The step is rotated by the heading half way through it. Path length is taken as max + 3/8 min of the two.
+ */
+void Odometry::update() {
+  int d[ODO_WHEELS];
+  uint8_t oldSREG = SREG;
+  cli();
+  for (byte m = 0; m < ODO_WHEELS; m++) {
+    int c = count[m];
+    d[m] = c - seen[m];
+    seen[m] = c;
+  }
+  SREG = oldSREG;
+
+  int ahead = d[1] + d[3], side = d[0] + d[2], rotation = d[0] + d[1] - d[2] - d[3];
+  if (!ahead && !side && !rotation) {
+    speed += -speed >> ODO_SPEED_AVG; // Rounds down, so it reaches 0
+    return;
+  }
+
+  long dx = (long)ahead * step >> 9, // Mean of the pair, in 1/256 mm
+       dy = (long)side * step >> 9,
+       dh = (long)rotation * turn;
+  uint16_t mid = (headingFine + dh / 2) >> 16;
+  int c = sine(mid + 0x4000), s = sine(mid);
+  pose.x += (dx * c - dy * s) >> 14;
+  pose.y += (dx * s + dy * c) >> 14;
+  headingFine += dh;
+  pose.heading = headingFine >> 16;
+
+  long ax = dx < 0 ? -dx : dx, ay = dy < 0 ? -dy : dy,
+       length = ax > ay ? ax + (ay * 3 >> 3) : ay + (ax * 3 >> 3);
+  path += length;
+  speed += (length - speed) >> ODO_SPEED_AVG;
+}
+
+/**
+ * Copy of the pose; the control tick may move it at any time
+ */
+Pose Odometry::getPose() {
+  uint8_t oldSREG = SREG;
+  cli();
+  Pose p = pose;
+  SREG = oldSREG;
+  return p;
+}
+
+long Odometry::travelled() {
+  uint8_t oldSREG = SREG;
+  cli();
+  unsigned long p = path;
+  SREG = oldSREG;
+  return p >> 8;
+}
+
+#ifdef ODOMETRY
+ISR(PCINT2_vect) {
+  Odometry::pinChange(PINK);
+}
+#endif
+
+#undef ODO_WHEELS
+#undef ODO_SPEED_AVG
+
+#endif
@@ -4,39 +4,156 @@
 /*
   Library to calculate voltage using PID controller
   kP, kI, kD are propotionality, integral and derivative constants respectively
+
+  The controller works in fixed-point, since the AVR has no FPU.
+  T holds the gains with FRAC fractional bits and W is wide enough for the products (Q8.8 or Q16.16).
+  Only integer arithmetic is used per step, so results are bit-identical on the host and on the Mega
+  (both are built with GCC, where >> on negative numbers is an arithmetic shift).
 */
 
-class PIDController {
+#include <stdint.h>
+
+
+#define PID_OUT_MAX 255 // Default output limit; full PWM range
+
+
+template <typename T, typename W, uint8_t FRAC>
+class FixedPIDController {
 
 private:
-  float kP, kI, kD;
-  int P, I, D;
-  int lastErr;
+  T kP, kI, kD;   // Gains with FRAC fractional bits
+  W P, I, D;      // Terms of the last step with FRAC fractional bits; D is low-pass filtered
+  W iSum,         // Accumulated error
+    iLimit,       // Limit on the integral term (anti-windup)
+    sumLimit;     // Matching limit on the accumulated error; iLimit / kI
+  int lastErr,
+      outMax;     // Output saturates at +-outMax
+  uint8_t dShift; // Derivative filter: D += (Draw - D) >> dShift; 0 disables the filter
+
+  void setIntegralGain(T); // Sets kI and the matching clamp on the accumulated error
 
 public:
-  PIDController(float const_p, float const_i, float const_d) {
-    kP = const_p;
-    kI = const_i;
-    kD = const_d;
+  static const uint8_t FRACTION = FRAC; // Fractional bits of gains and terms
+
+  struct Gains {
+    T kP, kI, kD; // Gains with FRAC fractional bits
+  };
 
-    P = I = D = 0;
+  FixedPIDController(float const_p, float const_i, float const_d, int out_max = PID_OUT_MAX) {
+    outMax = out_max;
+    iLimit = (W)out_max << FRAC; // No windup beyond what the output can use
+    setGains(const_p, const_i, const_d);
+    dShift = 0;
+    reset();
+  }
 
-    lastErr = 0;
+  static T toFixed(float); // Converts a gain to fixed-point; rounds to nearest
+  static Gains makeGains(float const_p, float const_i, float const_d) {
+    Gains g = {toFixed(const_p), toFixed(const_i), toFixed(const_d)};
+    return g;
   }
 
-  int calcVolt(int);
+  void setGains(float, float, float);
+  void setGains(const Gains &); // Switches to pre-converted gains; no float math
+  void setIntegralLimit(W limit) { iLimit = limit; setIntegralGain(kI); }
+  void setDerivativeFilter(uint8_t shift) { dShift = shift; }
+  void reset();
+
+  int calcOutput(int); // Signed output, saturated to +-outMax
+  int calcVolt(int);   // Absolute value of the output
 
+  W getP() { return P; }
+  W getI() { return I; }
+  W getD() { return D; }
 };
 
-int PIDController::calcVolt(int err) {
-  P = kP * err;
-  I += err;
-  D = kD * (err - lastErr);
-  int result = P + (kI * I) + D;
+template <typename T, typename W, uint8_t FRAC>
+T FixedPIDController<T, W, FRAC>::toFixed(float gain) {
+  float scaled = gain * (float)((W)1 << FRAC);
+  return (T)(scaled >= 0 ? scaled + 0.5f : scaled - 0.5f);
+}
+
+template <typename T, typename W, uint8_t FRAC>
+void FixedPIDController<T, W, FRAC>::setGains(float const_p, float const_i, float const_d) {
+  kP = toFixed(const_p);
+  kD = toFixed(const_d);
+  setIntegralGain(toFixed(const_i));
+}
+
+template <typename T, typename W, uint8_t FRAC>
+void FixedPIDController<T, W, FRAC>::setGains(const Gains &g) {
+  kP = g.kP;
+  kD = g.kD;
+  if (g.kI != kI)
+    setIntegralGain(g.kI);
+}
+
+template <typename T, typename W, uint8_t FRAC>
+void FixedPIDController<T, W, FRAC>::setIntegralGain(T const_i) {
+  kI = const_i;
+  sumLimit = kI > 0 ? iLimit / kI : 0; // Division happens only when gains change
+}
+
+/**
+ * Clears the stored state; gains and limits are kept
+ */
+template <typename T, typename W, uint8_t FRAC>
+void FixedPIDController<T, W, FRAC>::reset() {
+  P = I = D = 0;
+  iSum = 0;
+  lastErr = 0;
+}
+
+/**
+ * Calculates the signed PID output for the given error
+ * The accumulated error is clamped and the output is saturated to the PWM range
+ * @param int err   Current error
+ * @return int out  Output rounded to nearest, within +-outMax
+ */
+template <typename T, typename W, uint8_t FRAC>
+int FixedPIDController<T, W, FRAC>::calcOutput(int err) {
+  P = (W)kP * err;
+
+  // Clamp the sum so that kI * iSum stays within iLimit
+  iSum += err;
+  if (iSum > sumLimit)
+    iSum = sumLimit;
+  else if (iSum < -sumLimit)
+    iSum = -sumLimit;
+  I = (W)kI * iSum;
+
+  W dRaw = (W)kD * (err - lastErr);
+  if (dShift)
+    D += (dRaw - D) >> dShift;
+  else
+    D = dRaw;
 
   lastErr = err; // Storing error for future use
 
+  // Halves round away from zero on both sides, so that equal errors either way steer equally;
+  // the negative side is rounded as a positive number, since >> alone rounds it down
+  W sum = P + I + D,
+    half = (W)1 << (FRAC - 1),
+    result = sum >= 0 ? (sum + half) >> FRAC : -((-sum + half) >> FRAC);
+
+  if (result > outMax)
+    return outMax;
+  if (result < -outMax)
+    return -outMax;
+  return result;
+}
+
+template <typename T, typename W, uint8_t FRAC>
+int FixedPIDController<T, W, FRAC>::calcVolt(int err) {
+  int result = calcOutput(err);
   return (result > 0) ? result : -result; // Returning absolute value of the result
 }
 
+
+typedef FixedPIDController<int16_t, int32_t, 8> PIDControllerQ8_8;    // Gains upto +-127
+typedef FixedPIDController<int32_t, int64_t, 16> PIDControllerQ16_16; // Gains upto +-32767
+typedef PIDControllerQ8_8 PIDController;
+
+#undef PID_OUT_MAX
+
 #endif
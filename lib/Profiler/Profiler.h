@@ -0,0 +1,164 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+  Cycle counts of the control loop, taken from Timer1 running at the CPU clock.
+  Each section keeps min / max / mean and a histogram with one bucket per power of two,
+  so a 1000 cycle section and a 2000 cycle outlier land in different buckets.
+  Sections longer than 65535 cycles (4 ms) wrap; the control tick is far shorter.
+
+  Everything here compiles out unless PROFILE is defined (e.g. build_flags = -D PROFILE);
+  the PROFILE_* macros then expand to nothing.
+*/
+
+#include <Arduino.h>
+#include <TelemetryRecord.h>
+
+
+// Timed sections
+enum ProfileSection {
+  PROFILE_TICK,     // Whole control tick
+  PROFILE_SENSOR,   // capture() and calcDeviation()
+  PROFILE_PID,      // Gain schedule and calcOutput()
+  PROFILE_MOTOR,    // move() and commit(); commit() alone while stopped
+  PROFILE_PERIOD,   // Start of one tick to the start of the next; jitter of the loop
+  PROFILE_SECTIONS
+};
+
+#ifdef PROFILE
+
+#define PROFILE_BUCKETS 16 // log2 buckets of a 16 bit count
+
+#define PROFILE_MARK(t) uint16_t t = TCNT1                      // Start of a section
+#define PROFILE_SINCE(s, t) Profiler::add(s, TCNT1 - (t))       // End of a section started at mark t
+#define PROFILE_SPLIT(s, t) (t = Profiler::split(s, t))         // End of a section; the next one starts at t
+#define PROFILE_LAP(s) Profiler::lap(s)                         // Time since the last lap of s
+
+
+struct ProfileStats {
+  uint16_t min, max,
+           count;                       // Samples; saturates
+  uint32_t sum;                         // Sum of the samples counted
+  uint8_t hist[PROFILE_BUCKETS];        // Samples per bucket; halved together when one fills up
+};
+
+
+class Profiler {
+
+private:
+  static ProfileStats stats[PROFILE_SECTIONS];
+  static uint16_t lastLap;
+  static bool lapped;
+
+public:
+  static void begin();                  // Starts Timer1 and clears the stats
+  static void reset();
+  static void add(byte, uint16_t);      // Adds a sample; Parameters - section, cycles
+  static uint16_t split(byte, uint16_t); // Adds the time since a mark; Parameters - section, mark. Returns the new mark
+  static void lap(byte);                // Adds the time since the previous lap; Parameter - section
+  static bool report(byte, ProfileRecord &); // Copies the stats of a section; false if it has no samples
+};
+
+ProfileStats Profiler::stats[PROFILE_SECTIONS];
+uint16_t Profiler::lastLap = 0;
+bool Profiler::lapped = false;
+
+/**
+ * Runs Timer1 free at the CPU clock
+ * Timer1 is reserved for this; the other timers drive the motors, servo and control loop
+ */
+void Profiler::begin() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  reset();
+}
+
+void Profiler::reset() {
+  uint8_t oldSREG = SREG;
+  cli();
+  for (byte s = 0; s < PROFILE_SECTIONS; s++) {
+    memset(&stats[s], 0, sizeof(ProfileStats));
+    stats[s].min = 0xFFFF;
+  }
+  lapped = false;
+  SREG = oldSREG;
+}
+
+/**
+ * Adds one sample to a section
+ * Called with interrupts disabled (from the timer interrupt), or from code it cannot interrupt
+ * @param byte     s      Section
+ * @param uint16_t cycles Length of the sample
+ */
+void Profiler::add(byte s, uint16_t cycles) {
+  ProfileStats &st = stats[s];
+
+  if (st.count == 0xFFFF)
+    return; // The mean is over the first 65535 samples
+  st.count++;
+  st.sum += cycles;
+  if (cycles < st.min)
+    st.min = cycles;
+  if (cycles > st.max)
+    st.max = cycles;
+
+  byte b = 0; // floor(log2(cycles))
+  if (cycles >> 8) {
+    b = 8;
+    cycles >>= 8;
+  }
+  while (cycles >>= 1)
+    b++;
+
+  if (st.hist[b] == 0xFF)
+    for (byte i = 0; i < PROFILE_BUCKETS; i++)
+      st.hist[i] >>= 1;
+  st.hist[b]++;
+}
+
+uint16_t Profiler::split(byte s, uint16_t mark) {
+  uint16_t now = TCNT1;
+  add(s, now - mark);
+  return now;
+}
+
+void Profiler::lap(byte s) {
+  uint16_t now = TCNT1;
+  if (lapped)
+    add(s, now - lastLap);
+  lastLap = now;
+  lapped = true;
+}
+
+/**
+ * Copies the stats of a section into a record for the telemetry link
+ * @param byte          s Section
+ * @param ProfileRecord r Filled in
+ * @return bool sampled   False if the section has no samples yet
+ */
+bool Profiler::report(byte s, ProfileRecord &r) {
+  uint8_t oldSREG = SREG;
+  cli();
+  const ProfileStats &st = stats[s];
+  r.section = s;
+  r.count = st.count;
+  r.min = st.min;
+  r.max = st.max;
+  r.mean = st.count ? st.sum / st.count : 0;
+  memcpy(r.hist, st.hist, PROFILE_BUCKETS);
+  SREG = oldSREG;
+  return r.count;
+}
+
+#undef PROFILE_BUCKETS
+
+#else
+
+#define PROFILE_MARK(t)
+#define PROFILE_SINCE(s, t)
+#define PROFILE_SPLIT(s, t)
+#define PROFILE_LAP(s)
+
+#endif
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef ROUTEPLANNER_H
+#define ROUTEPLANNER_H
+
+/*
+  Routes between the zones of the arena, planned once at boot.
+  The arena is a graph: nodes are the junctions the bot stops or turns at, edges are the straight lines
+  between them, with their length, heading and the cross-sections counted on the way (the far node included).
+  The first ROUTE_ZONES nodes are zones the mission moves between; each has the heading the bot faces there.
+  plan() runs a shortest path search from every zone, over (node, heading) so that turns have a cost, and keeps
+  the result as legs: turn, then follow the line over n cross-sections, with the length of line that takes.
+  Straight runs through nodes merge into one leg, which ControlLoop follows without stopping. The mission then
+  only looks routes up.
+  The blue half is the red half mirrored, so its routes are the red ones with left and right swapped.
+*/
+
+#include <Arduino.h>
+
+
+#ifndef ROUTE_ZONES
+#define ROUTE_ZONES 6       // Zones; the first nodes of the graph
+#endif
+#ifndef ROUTE_NODES
+#define ROUTE_NODES 8       // Nodes of the graph, zones included
+#endif
+#define ROUTE_LEGS 4        // Most legs on a route between two zones
+#ifndef ROUTE_TURN_COST
+#define ROUTE_TURN_COST 300 // Line (mm) a quarter turn is worth; the bot waits for the servo
+#endif
+#define ROUTE_BACK_COST 50  // Line (mm) a turn back is worth; it only flips the motors and the table
+#define ROUTE_STATES (ROUTE_NODES * 4)
+#define ROUTE_NONE 0xFF
+
+// Headings on the red half; clockwise, so that a change of 1 is a right turn
+enum Heading {
+  NORTH,
+  EAST,
+  SOUTH,
+  WEST
+};
+
+struct RouteEdge {
+  byte a, b,              // Nodes at the ends
+       heading,           // Heading from a to b
+       junctions;         // Cross-sections from one end to the other, the far end included
+  uint16_t length;        // mm
+};
+
+
+/*
+  A leg packs the turn into the top 2 bits, as the change of heading, and the cross-sections into the rest
+*/
+#define LEG_JUNCTIONS 0x3F
+
+// Turn before the leg, as motor.turn() and lfr.rotate() take it; 'f' is no turn
+inline char legTurn(byte leg) {
+  return "frbl"[leg >> 6];
+}
+
+// Cross-sections to pass; the bot stops at the last one. 0 only turns
+inline byte legJunctions(byte leg) {
+  return leg & LEG_JUNCTIONS;
+}
+
+
+class RoutePlanner {
+
+private:
+  byte route[ROUTE_ZONES][ROUTE_ZONES][ROUTE_LEGS], // Legs from a zone to another
+       legCount[ROUTE_ZONES][ROUTE_ZONES];
+  uint16_t length[ROUTE_ZONES][ROUTE_ZONES][ROUTE_LEGS]; // Line followed on each leg, mm
+
+  void search(const RouteEdge[], byte, const byte[], byte, bool); // Plans the routes from one zone
+
+public:
+  RoutePlanner() {
+    memset(legCount, 0, sizeof(legCount));
+  }
+
+  void plan(const RouteEdge[], byte, const byte[], bool); // Parameters - edges (PROGMEM), count, heading at each zone, blue half
+  byte legs(byte from, byte to) { return legCount[from][to]; }               // Legs of a route; 0 if there is none
+  byte leg(byte from, byte to, byte i) { return route[from][to][i]; }        // Leg i of a route
+  unsigned int legLength(byte from, byte to, byte i) { return length[from][to][i]; } // Line followed on leg i; mm
+  unsigned int distance(byte, byte);                                         // Line followed on a route; mm
+};
+
+// Cost of changing heading by d; 0 - 3
+inline unsigned int routeTurnCost(byte d) {
+  return d == 0 ? 0 : d == 2 ? ROUTE_BACK_COST : ROUTE_TURN_COST;
+}
+
+unsigned int RoutePlanner::distance(byte from, byte to) {
+  unsigned int mm = 0;
+  for (byte i = 0; i < legCount[from][to]; i++)
+    mm += length[from][to][i];
+  return mm;
+}
+
+/**
+ * Plans the routes between all pairs of zones
+ * @param RouteEdge[] edges   The graph; in PROGMEM
+ * @param byte        n       Number of edges
+ * @param byte[]      facing  Heading the bot has at each zone; RAM
+ * @param bool        blue    Mirror the routes for the blue half
+ */
+void RoutePlanner::plan(const RouteEdge edges[], byte n, const byte facing[], bool blue) {
+  for (byte z = 0; z < ROUTE_ZONES; z++)
+    search(edges, n, facing, z, blue);
+}
+
+/**
+ * Dijkstra over (node, heading) from one zone, then the legs to every other zone
+ * Each step follows an edge after turning onto its heading; the turn costs ROUTE_TURN_COST or ROUTE_BACK_COST.
+ * At the target the bot turns to the heading of the zone.
+ */
+void RoutePlanner::search(const RouteEdge edges[], byte n, const byte facing[], byte from, bool blue) {
+  unsigned int cost[ROUTE_STATES];
+  byte prev[ROUTE_STATES], // State each state is reached from
+       via[ROUTE_STATES];  // Edge it is reached by
+  bool done[ROUTE_STATES];
+  for (byte s = 0; s < ROUTE_STATES; s++) {
+    cost[s] = 0xFFFF;
+    prev[s] = ROUTE_NONE;
+    done[s] = false;
+  }
+  cost[from * 4 + facing[from]] = 0;
+
+  while (true) {
+    byte s = ROUTE_NONE; // Cheapest state not done
+    for (byte i = 0; i < ROUTE_STATES; i++)
+      if (!done[i] && cost[i] != 0xFFFF && (s == ROUTE_NONE || cost[i] < cost[s]))
+        s = i;
+    if (s == ROUTE_NONE)
+      break;
+    done[s] = true;
+
+    byte node = s >> 2, heading = s & 3;
+    for (byte e = 0; e < n; e++) {
+      byte a = pgm_read_byte(&edges[e].a), b = pgm_read_byte(&edges[e].b), h = pgm_read_byte(&edges[e].heading);
+      if (node != a && node != b)
+        continue;
+      byte to = node == a ? b : a;
+      if (node == b)
+        h = (h + 2) & 3; // Edge taken backwards
+      unsigned int c = cost[s] + routeTurnCost((h - heading) & 3) + pgm_read_word(&edges[e].length);
+      byte t = to * 4 + h;
+      if (c < cost[t]) {
+        cost[t] = c;
+        prev[t] = s;
+        via[t] = e;
+      }
+    }
+  }
+
+  for (byte to = 0; to < ROUTE_ZONES; to++) {
+    legCount[from][to] = 0;
+    if (to == from)
+      continue;
+
+    byte end = ROUTE_NONE; // Cheapest arrival, with the turn to the zone's heading
+    unsigned int best = 0xFFFF;
+    for (byte h = 0; h < 4; h++) {
+      byte s = to * 4 + h;
+      if (cost[s] != 0xFFFF && cost[s] + routeTurnCost((facing[to] - h) & 3) < best) {
+        best = cost[s] + routeTurnCost((facing[to] - h) & 3);
+        end = s;
+      }
+    }
+    if (end == ROUTE_NONE)
+      continue;
+
+    byte path[ROUTE_STATES], steps = 0; // States from the target back to the zone
+    for (byte s = end; s != ROUTE_NONE; s = prev[s])
+      path[steps++] = s;
+
+    byte *out = route[from][to], count = 0, heading = facing[from];
+    uint16_t *mm = length[from][to];
+    bool fits = true;
+    for (byte i = steps - 1; i > 0; i--) {
+      byte e = via[path[i - 1]], h = path[i - 1] & 3, turn = (h - heading) & 3,
+           j = pgm_read_byte(&edges[e].junctions);
+      uint16_t l = pgm_read_word(&edges[e].length);
+      if (!turn && count) {
+        if (legJunctions(out[count - 1]) + j > LEG_JUNCTIONS)
+          fits = false; // More cross-sections than a leg holds
+        out[count - 1] += j; // Straight on through the node; one leg
+        mm[count - 1] += l;
+      }
+      else if (count < ROUTE_LEGS && j <= LEG_JUNCTIONS) {
+        mm[count] = l;
+        out[count++] = turn << 6 | j;
+      }
+      else
+        fits = false;
+      heading = h;
+    }
+    byte turn = (facing[to] - heading) & 3;
+    if (turn) {
+      if (count < ROUTE_LEGS) {
+        mm[count] = 0;
+        out[count++] = turn << 6; // Turn only; face the way the zone needs
+      }
+      else
+        fits = false;
+    }
+
+    if (blue)
+      for (byte i = 0; i < count; i++)
+        out[i] = ((4 - (out[i] >> 6)) & 3) << 6 | (out[i] & LEG_JUNCTIONS); // Left for right
+    legCount[from][to] = fits ? count : 0; // Routes that do not fit are not kept; raise ROUTE_LEGS
+  }
+}
+
+#undef ROUTE_STATES
+#undef ROUTE_NONE
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/*
+  Cooperative scheduler for millis() based tasks.
+  Tasks are plain functions which must return quickly; run() is called on every pass of loop(),
+  so waiting on a timer never blocks sampling, telemetry or the mission state machine.
+*/
+
+#include <Arduino.h>
+
+
+#define MAX_TASKS 8 // Task slots available
+
+
+typedef void (*TaskFunction)();
+
+struct Task {
+  TaskFunction fn;      // Function to run; 0 if the slot is free
+  unsigned long period, // Interval for periodic tasks; 0 for one-shot tasks
+                last,   // Time at which the task was scheduled or last run
+                wait;   // Time to wait from last
+};
+
+
+class Scheduler {
+
+private:
+  Task tasks[MAX_TASKS];
+
+  int add(TaskFunction, unsigned long, unsigned long); // Adds a task to a free slot
+
+public:
+  Scheduler();
+  int every(unsigned long, TaskFunction); // Runs a function periodically; Parameters - period (ms), function
+  int after(unsigned long, TaskFunction); // Runs a function once; Parameters - delay (ms), function
+  void cancel(int);                       // Removes a task; Parameter - task id
+  bool isPending(int);                    // Checks if a task is still scheduled; Parameter - task id
+  void run();                             // Runs all the tasks which are due
+};
+
+/**
+ * Constructor
+ * Marks all task slots as free
+ */
+Scheduler::Scheduler() {
+  for (int i = 0; i < MAX_TASKS; i++)
+    tasks[i].fn = 0;
+}
+
+/**
+ * Stores a task in the first free slot
+ * @param TaskFunction  fn     Function to run
+ * @param unsigned long wait   Time before the first run
+ * @param unsigned long period Interval between runs; 0 for a one-shot task
+ * @return int id   Index of the slot; -1 if all slots are used
+ */
+int Scheduler::add(TaskFunction fn, unsigned long wait, unsigned long period) {
+  for (int i = 0; i < MAX_TASKS; i++)
+    if (!tasks[i].fn) {
+      tasks[i].fn = fn;
+      tasks[i].period = period;
+      tasks[i].wait = wait;
+      tasks[i].last = millis();
+      return i;
+    }
+  return -1;
+}
+
+int Scheduler::every(unsigned long period, TaskFunction fn) {
+  return add(fn, period, period);
+}
+
+int Scheduler::after(unsigned long wait, TaskFunction fn) {
+  return add(fn, wait, 0);
+}
+
+void Scheduler::cancel(int id) {
+  if (id >= 0 && id < MAX_TASKS)
+    tasks[id].fn = 0;
+}
+
+bool Scheduler::isPending(int id) {
+  return id >= 0 && id < MAX_TASKS && tasks[id].fn;
+}
+
+/**
+ * Runs every task whose time has come
+ * Time is compared as a difference, so millis() overflow is handled
+ */
+void Scheduler::run() {
+  unsigned long now = millis();
+  for (int i = 0; i < MAX_TASKS; i++) {
+    if (!tasks[i].fn || now - tasks[i].last < tasks[i].wait)
+      continue;
+
+    TaskFunction fn = tasks[i].fn;
+    if (tasks[i].period) {
+      tasks[i].last += tasks[i].wait; // Keep a fixed rate
+      tasks[i].wait = tasks[i].period;
+    }
+    else
+      tasks[i].fn = 0; // One-shot task is done; free the slot first so fn can reschedule
+    fn();
+  }
+}
+
+#undef MAX_TASKS
+
+#endif
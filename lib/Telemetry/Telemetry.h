@@ -0,0 +1,147 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/*
+  Binary telemetry over USART0.
+  Records are COBS encoded into a ring buffer in SRAM, and the data register empty interrupt drains it,
+  so logging from the control loop never waits on the UART. When the buffer is full the record is dropped and counted.
+  Takes over USART0 from the Arduino Serial object; do not use Serial with it.
+  Programs which keep Serial define TELEMETRY_NO_UART before including this, and must not call begin() or send().
+  Commands from the host are polled with read(); they are rare, so the receiver has no buffer.
+*/
+
+#include <Arduino.h>
+#include "TelemetryRecord.h"
+
+
+#define TELEMETRY_BUFFER 256 // Ring buffer size; indices wrap as bytes
+
+
+class Telemetry {
+
+private:
+  volatile byte buffer[TELEMETRY_BUFFER];
+  volatile byte head,         // Next byte to be written
+                tail;         // Next byte to be sent
+  volatile unsigned int dropped;
+  byte state;                 // Mission state added to each record
+
+public:
+  static Telemetry *active;   // Telemetry serviced by the UART interrupt
+
+  Telemetry() {
+    head = tail = 0;
+    dropped = 0;
+    state = 0;
+  }
+
+  void begin(unsigned long, bool = false); // Sets up USART0; Parameters - baud rate, receive commands
+  bool send(TelemetryRecord &);         // Queues a record; false if it was dropped
+  bool send(const void *, byte);        // Queues any frame; Parameters - data, size (< 254)
+  int read();                           // Command byte from the host; -1 if none
+  void setState(byte s) { state = s; }
+  unsigned int getDropped() { return dropped; }
+  void isr();                           // Sends the next byte; called from the UART interrupt
+};
+
+Telemetry *Telemetry::active = 0;
+
+/**
+ * Configures USART0 as 8N1 with double speed
+ * The receiver is only enabled when commands are asked for
+ * @param unsigned long baud      Baud rate
+ * @param bool          commands  Enable the receiver for read()
+ */
+void Telemetry::begin(unsigned long baud, bool commands) {
+  active = this;
+
+  UCSR0A = _BV(U2X0);
+  UBRR0 = (F_CPU / 4 / baud - 1) / 2; // Rounded, as in HardwareSerial
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  UCSR0B = _BV(TXEN0) | (commands ? _BV(RXEN0) : 0);
+}
+
+/**
+ * Queues a record, tagged with the mission state
+ * @param TelemetryRecord r  The record; its state is filled in here
+ * @return bool queued  False if there was no room
+ */
+bool Telemetry::send(TelemetryRecord &r) {
+  r.state = state;
+  return send(&r, sizeof(TelemetryRecord));
+}
+
+/**
+ * COBS encodes a frame into the ring buffer and starts the transmission
+ * Interrupts are held off while encoding, so the control loop and the main loop can both send
+ * @param void* frame  Data
+ * @param byte  size   Size of the data; less than 254 bytes, so one code byte is added
+ * @return bool queued  False if there was no room
+ */
+bool Telemetry::send(const void *frame, byte size) {
+  const byte *data = (const byte *)frame;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  byte used = head - tail;
+  if (TELEMETRY_BUFFER - 1 - used < size + 2) { // Code byte and delimiter
+    dropped++;
+    SREG = oldSREG;
+    return false;
+  }
+
+  byte pos = head,        // Where the data goes
+       codePos = pos++,   // Where the current block's code goes
+       code = 1;          // Distance to the next zero
+  for (byte i = 0; i < size; i++) {
+    if (data[i]) {
+      buffer[pos++] = data[i];
+      code++;
+    }
+    else {
+      buffer[codePos] = code;
+      codePos = pos++;
+      code = 1;
+    }
+  }
+  buffer[codePos] = code;
+  buffer[pos++] = 0; // Frame delimiter
+
+  head = pos;
+  UCSR0B |= _BV(UDRIE0); // Drained by the interrupt
+  SREG = oldSREG;
+  return true;
+}
+
+/**
+ * Polls the receiver for a command
+ * @return int command  Byte received, or -1
+ */
+int Telemetry::read() {
+  if (!(UCSR0A & _BV(RXC0)))
+    return -1;
+  return UDR0;
+}
+
+/**
+ * Moves one byte to the UART; disables the interrupt when the buffer is empty
+ */
+void Telemetry::isr() {
+  if (head == tail) {
+    UCSR0B &= ~_BV(UDRIE0);
+    return;
+  }
+  UDR0 = buffer[tail];
+  tail = tail + 1;
+}
+
+#ifndef TELEMETRY_NO_UART
+ISR(USART0_UDRE_vect) {
+  if (Telemetry::active)
+    Telemetry::active->isr();
+}
+#endif
+
+#undef TELEMETRY_BUFFER
+
+#endif
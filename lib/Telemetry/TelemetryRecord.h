@@ -0,0 +1,40 @@
+#ifndef TELEMETRYRECORD_H
+#define TELEMETRYRECORD_H
+
+/*
+  Layout of the telemetry frames; shared by the firmware and tools/telemetry_decode.cpp.
+  Little-endian and packed, as laid out by avr-gcc. Each frame is sent COBS encoded,
+  followed by a 0 delimiter. Frame types are told apart by their length.
+*/
+
+#include <stdint.h>
+
+
+struct TelemetryRecord {
+  uint32_t tick;      // Control tick
+  uint8_t sensors;    // Packed IR array; bit i is sensor i
+  int8_t deviation;   // Deviation from the line
+  int16_t p, i, d;    // PID terms, in output units
+  uint8_t pwm[4];     // PWM duty of motors 0 - 3 (front, right, back, left as wired)
+  uint8_t dir;        // DIR level of motor i in bit i
+  uint8_t state;      // Mission state
+} __attribute__((packed));
+
+static_assert(sizeof(TelemetryRecord) == 18, "Telemetry record layout changed; update tools/telemetry_decode.cpp");
+
+// Cycle counts of one profiled section; sent when the host asks with TELEMETRY_PROFILE
+struct ProfileRecord {
+  uint8_t section;    // ProfileSection
+  uint16_t count,     // Samples
+           min, max, mean;
+  uint8_t hist[16];   // Samples of 2^i upto 2^(i + 1) - 1 cycles; relative counts
+} __attribute__((packed));
+
+static_assert(sizeof(ProfileRecord) == 25, "Profile record layout changed; update tools/telemetry_decode.cpp");
+
+
+// Commands from the host; single bytes
+#define TELEMETRY_PROFILE 'p'       // Send a ProfileRecord per section
+#define TELEMETRY_PROFILE_RESET 'r' // Clear the profile
+
+#endif
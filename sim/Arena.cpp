@@ -0,0 +1,133 @@
+/*
+    Description: Lines of the game field (img/Arena.png) for the arena simulator.
+    Only the lines the automatic robot follows are modelled: the path from the starting zone
+    down to the two loading points, and the rows through the throwing zones with their 300 mm marks.
+    Junctions have their shape on the field: the line from the starting zone ends at the path, so the
+    first turn is a corner, and every other junction the bot passes is a full cross.
+    The blue half is the red half mirrored about the centre of the field.
+*/
+
+#include <math.h>
+#include "Sim.h"
+
+
+#define MAX_SEGMENTS 24
+#define MARK 150 // Half length of the short marks around a throwing position
+
+static Segment lines[MAX_SEGMENTS];
+static int totalLines = 0;
+static bool mirrored = false;
+
+// Red half
+static const Point start = {550, 7540},       // Automatic robot starting zone
+                   tzCentre[MAX_TZ] = {
+                       {3785, 3040},           // TZ1; upper row
+                       {3785, 1035},           // TZ2; lower row
+                       {7060, 1035}            // TZ3; lower row
+                   };
+
+static const double loadingRow = 3040,         // Row through loading point 1 and TZ1
+                    lowerRow = 1035,           // Row through loading point 2, TZ2 and TZ3
+                    pathX = 1095;              // Line from the starting zone down to the loading points
+
+
+static Point place(double x, double y) {
+    Point p = {mirrored ? ARENA_SIZE - x : x, y};
+    return p;
+}
+
+static void addLine(double x1, double y1, double x2, double y2) {
+    if (totalLines < MAX_SEGMENTS) {
+        lines[totalLines].a = place(x1, y1);
+        lines[totalLines].b = place(x2, y2);
+        totalLines++;
+    }
+}
+
+/**
+ * Adds a cross-section mark perpendicular to a row
+ */
+static void addMark(double x, double y) {
+    addLine(x, y - MARK, x, y + MARK);
+}
+
+void arenaInit(bool blue) {
+    mirrored = blue;
+    totalLines = 0;
+
+    // Starting zone to the path; the cross in the starting zone and the corner of the first turn
+    addLine(50, start.y, pathX, start.y);
+    addLine(start.x, start.y - 500, start.x, start.y + 500);
+    addLine(pathX, start.y, pathX, 50);
+
+    // Upper row: loading point 1, marks and TZ1
+    addLine(50, loadingRow, 5385, loadingRow);
+    addMark(2980, loadingRow);
+    addLine(3785, 2070, 3785, 4010);
+    addMark(4590, loadingRow);
+
+    // Lower row: loading point 2, marks, TZ2 and TZ3
+    addLine(50, lowerRow, 8690, lowerRow);
+    addMark(2980, lowerRow);
+    addLine(3785, 50, 3785, 2035);
+    addMark(4590, lowerRow);
+    addMark(6255, lowerRow);
+    addLine(7060, 50, 7060, 2035);
+    addMark(7865, lowerRow);
+}
+
+/**
+ * Square of the distance from a point to a segment
+ */
+static double distance2(Point p, Segment s) {
+    double dx = s.b.x - s.a.x, dy = s.b.y - s.a.y,
+           len2 = dx * dx + dy * dy,
+           t = len2 > 0 ? ((p.x - s.a.x) * dx + (p.y - s.a.y) * dy) / len2 : 0;
+    if (t < 0)
+        t = 0;
+    else if (t > 1)
+        t = 1;
+    double ex = s.a.x + t * dx - p.x, ey = s.a.y + t * dy - p.y;
+    return ex * ex + ey * ey;
+}
+
+/**
+ * Checks if a point is on a white line
+ * Called for every sensor at every reading, so points outside a line's bounding box are passed over first
+ */
+bool arenaOnLine(Point p) {
+    const double r = LINE_WIDTH / 2.0;
+    for (int i = 0; i < totalLines; i++) {
+        const Segment &s = lines[i];
+        if (p.x < fmin(s.a.x, s.b.x) - r || p.x > fmax(s.a.x, s.b.x) + r ||
+            p.y < fmin(s.a.y, s.b.y) - r || p.y > fmax(s.a.y, s.b.y) + r)
+            continue;
+        if (distance2(p, s) <= r * r)
+            return true;
+    }
+    return false;
+}
+
+Point arenaStart() {
+    return place(start.x, start.y);
+}
+
+double arenaStartHeading() {
+    return mirrored ? M_PI : 0; // Facing the path
+}
+
+Point arenaThrowingZone(int tz) {
+    return place(tzCentre[tz - 1].x, tzCentre[tz - 1].y);
+}
+
+Point arenaStraight() {
+    return place(pathX, start.y - 300);
+}
+
+double arenaStraightHeading() {
+    return -M_PI / 2; // Down the path on both halves
+}
+
+bool arenaInside(Point p) {
+    return p.x >= 0 && p.x <= ARENA_SIZE && p.y >= 0 && p.y <= ARENA_SIZE;
+}
@@ -0,0 +1,442 @@
+/*
+    Description: Arduino API for the arena simulator.
+    Time is virtual: every call costs a rough number of CPU cycles, and delay() skips ahead.
+    Timer2 is emulated from its registers, so ISR(TIMER2_COMPA_vect) runs at the configured rate.
+    Timer1 only counts, for the profiler.
+    The ADC converts free-running at its prescaled clock, and ISR(ADC_vect) gets each result.
+    USART1 receives a reading of the IR array (or the next byte of a replay file) every frame time,
+    and ISR(USART1_RX_vect) gets each byte.
+    The USART0 transmitter takes one frame time per byte written to UDR0, and ISR(USART0_UDRE_vect)
+    runs whenever the data register is empty and the interrupt is enabled.
+    PINK reads the wheel encoders. Their next edge is foreseen from the wheel speeds, and ISR(PCINT2_vect)
+    runs on every change of an enabled pin.
+*/
+
+#include <Arduino.h>
+#include <Servo.h>
+#include <EEPROM.h>
+#include <stdio.h>
+#include "Sim.h"
+
+
+// Approximate cost of each call on the Mega, in cycles
+#define COST_PIN      60
+#define COST_ANALOG   1700 // One ADC conversion
+#define COST_CLOCK    30
+#define COST_SERIAL   20
+#define COST_EEPROM_READ  4
+#define COST_EEPROM_WRITE (F_CPU / 300) // 3.3 ms
+#define COST_PCINT    70   // Entry, decoding and exit of the encoder interrupt
+#define PHYSICS_STEP  (F_CPU / 1000) // Bot motion is integrated at 1 kHz or finer
+
+uint64_t simCycles = 0;
+bool simVerbose = false;
+
+volatile uint8_t SREG = 0x80; // Interrupts are enabled by the core before setup()
+volatile uint8_t TCCR1A, TCCR1B;
+SimCounter TCNT1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C;
+volatile uint16_t UBRR0;
+SimDataRegister UDR0;
+volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+volatile uint8_t UCSR1A, UCSR1B, UCSR1C, UDR1;
+volatile uint16_t UBRR1;
+volatile uint16_t ADC;
+volatile uint8_t DDRK, PORTK, PCICR, PCMSK2;
+SimPort PINK;
+
+HardwareSerial Serial(0), Serial1(1);
+EEPROMClass EEPROM;
+
+void TIMER2_COMPA_vect() __attribute__((weak));
+void USART0_UDRE_vect() __attribute__((weak));
+void ADC_vect() __attribute__((weak));
+void USART1_RX_vect() __attribute__((weak));
+void PCINT2_vect() __attribute__((weak));
+
+static uint64_t physicsCycles = 0, // Time upto which the bot has been moved
+                timer2Next = 0,    // Time of the next Timer2 compare match
+                adcNext = 0,       // Time the running ADC conversion completes
+                uart1Next = 0,     // Time the next byte is received on USART1
+                udr0Empty = 0;     // Time the USART0 data register is free again
+static int pcintSeen = -1;         // Port K as the last pin change interrupt saw it; -1 while it is off
+static bool inISR = false;
+static FILE *capture = 0,          // Receives the bytes sent through USART0
+            *replay = 0;           // Bytes received on USART1, instead of the IR array
+static uint8_t eeprom[SIM_EEPROM_SIZE];
+
+
+/**
+ * Cycles between Timer2 compare matches; 0 if the timer is stopped
+ */
+static uint64_t timer2Period() {
+    static const uint16_t prescalers[] = {0, 1, 8, 32, 64, 128, 256, 1024};
+    return (uint64_t)prescalers[TCCR2B & 0x07] * (OCR2A + 1);
+}
+
+/**
+ * Cycles per ADC conversion in free-running mode; 0 if it is not converting with the interrupt on
+ */
+static uint64_t adcPeriod() {
+    static const uint8_t mask = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE);
+    if ((ADCSRA & mask) != mask)
+        return 0;
+    return (uint64_t)13 << ((ADCSRA & 0x07) ? (ADCSRA & 0x07) : 1);
+}
+
+/**
+ * Cycles to send one 8N1 frame through USART0
+ */
+static uint64_t uart0Frame() {
+    return (uint64_t)10 * (UCSR0A & _BV(U2X0) ? 8 : 16) * (UBRR0 + 1);
+}
+
+/**
+ * Cycles to receive one 8N1 frame on USART1
+ */
+static uint64_t uart1Frame() {
+    return (uint64_t)10 * (UCSR1A & _BV(U2X1) ? 8 : 16) * (UBRR1 + 1);
+}
+
+/**
+ * Next byte on the wire to USART1
+ * The replay file is sent once and the line then stays idle; -1 means nothing is sent
+ */
+static int uart1Byte() {
+    if (!replay)
+        return robotUartRead();
+    return fgetc(replay);
+}
+
+/**
+ * Moves the bot upto the given time
+ */
+static void physicsTo(uint64_t t) {
+    while (physicsCycles < t) {
+        uint64_t step = t - physicsCycles;
+        if (step > PHYSICS_STEP)
+            step = PHYSICS_STEP;
+        robotStep((double)step / F_CPU);
+        physicsCycles += step;
+    }
+}
+
+/**
+ * Advances the virtual clock
+ * Timer2 interrupts which fall due are serviced on the way, unless interrupts are disabled or one is running
+ * @param uint32_t cycles   CPU cycles to advance
+ */
+void simAdvance(uint32_t cycles) {
+    uint64_t target = simCycles + cycles;
+
+    while (!inISR && (SREG & 0x80)) {
+        uint64_t period = timer2Period(),
+                 next = target + 1;
+        void (*vector)() = 0;
+
+        if (period && (TIMSK2 & _BV(OCIE2A)) && TIMER2_COMPA_vect) {
+            if (!timer2Next)
+                timer2Next = simCycles + period; // Timer was just started
+            next = timer2Next;
+            vector = TIMER2_COMPA_vect;
+        }
+        uint64_t conversion = adcPeriod();
+        if (conversion && ADC_vect) {
+            if (!adcNext)
+                adcNext = simCycles + conversion; // Conversions were just started
+            if (adcNext < next) {
+                next = adcNext;
+                vector = ADC_vect;
+            }
+        }
+        else
+            adcNext = 0;
+        if ((UCSR1B & _BV(RXEN1)) && (UCSR1B & _BV(RXCIE1)) && USART1_RX_vect) {
+            if (!uart1Next)
+                uart1Next = simCycles + uart1Frame(); // Receiver was just enabled
+            if (uart1Next < next) {
+                next = uart1Next;
+                vector = USART1_RX_vect;
+            }
+        }
+        else
+            uart1Next = 0;
+        if ((PCICR & _BV(PCIE2)) && PCMSK2 && PCINT2_vect) {
+            if (pcintSeen < 0)
+                pcintSeen = robotEncoders(); // Interrupt was just enabled
+            uint64_t due = target + 1;
+            if ((robotEncoders() ^ pcintSeen) & PCMSK2)
+                due = simCycles; // Changed while interrupts were off; the flag is pending
+            else {
+                double s = robotEncoderDue();
+                if (s < (double)(target - simCycles) / F_CPU)
+                    due = simCycles + (s * F_CPU > 1 ? (uint64_t)(s * F_CPU) : 1);
+            }
+            if (due < next) {
+                next = due;
+                vector = PCINT2_vect;
+            }
+        }
+        else
+            pcintSeen = -1;
+        if ((UCSR0B & _BV(UDRIE0)) && USART0_UDRE_vect) {
+            uint64_t due = udr0Empty > simCycles ? udr0Empty : simCycles;
+            if (due < next) {
+                next = due;
+                vector = USART0_UDRE_vect;
+            }
+        }
+        if (!vector || next > target)
+            break;
+
+        physicsTo(next);
+        if (simCycles < next)
+            simCycles = next;
+        if (vector == TIMER2_COMPA_vect)
+            timer2Next += period;
+        if (vector == ADC_vect) {
+            ADC = robotAnalogRead((ADCSRB & _BV(MUX5) ? 8 : 0) | (ADMUX & 0x07));
+            adcNext += conversion;
+        }
+        if (vector == USART1_RX_vect) {
+            uart1Next += uart1Frame();
+            int c = uart1Byte();
+            if (c < 0)
+                continue; // Idle line; no interrupt
+            UDR1 = c;
+        }
+        if (vector == PCINT2_vect) {
+            int pins = robotEncoders();
+            if (!((pins ^ pcintSeen) & PCMSK2))
+                continue; // Wheel slowed down short of the edge
+            pcintSeen = pins;
+        }
+
+        inISR = true;
+        vector();
+        if (vector == PCINT2_vect)
+            simAdvance(COST_PCINT);
+        inISR = false;
+
+        if (target < simCycles)
+            target = simCycles;
+    }
+
+    physicsTo(target);
+    simCycles = target;
+}
+
+void simIdle() {
+    uint64_t period = timer2Period();
+    if (period && timer2Next > simCycles)
+        simAdvance(timer2Next - simCycles);
+    else
+        simAdvance(F_CPU / 1000);
+}
+
+double simSeconds() {
+    return (double)simCycles / F_CPU;
+}
+
+/**
+ * Sets the virtual clock back to 0
+ * Only before setup(), while no timer, conversion or USART is running
+ */
+void simRestart() {
+    simCycles = physicsCycles = 0;
+}
+
+
+void cli() {
+    SREG &= ~0x80;
+}
+
+void sei() {
+    SREG |= 0x80;
+}
+
+
+void pinMode(uint8_t, uint8_t) {
+    simAdvance(COST_PIN);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    simAdvance(COST_PIN);
+    robotPinWrite(pin, value ? 255 : 0);
+}
+
+int digitalRead(uint8_t pin) {
+    simAdvance(COST_PIN);
+    return robotPinRead(pin);
+}
+
+void analogWrite(uint8_t pin, int value) {
+    simAdvance(COST_PIN);
+    robotPinWrite(pin, value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+int analogRead(uint8_t pin) {
+    simAdvance(COST_ANALOG);
+    return robotPinRead(pin) ? 1023 : 0;
+}
+
+unsigned long millis() {
+    simAdvance(COST_CLOCK);
+    return simCycles / (F_CPU / 1000);
+}
+
+unsigned long micros() {
+    simAdvance(COST_CLOCK);
+    return simCycles / (F_CPU / 1000000);
+}
+
+void delay(unsigned long ms) {
+    uint64_t end = simCycles + (uint64_t)ms * (F_CPU / 1000);
+    while (simCycles < end) {
+        uint64_t step = end - simCycles;
+        simAdvance(step > PHYSICS_STEP ? PHYSICS_STEP : step);
+    }
+}
+
+void delayMicroseconds(unsigned int us) {
+    simAdvance(us * (F_CPU / 1000000));
+}
+
+void yield() {
+    simIdle();
+}
+
+
+void Servo::write(int a) {
+    angle = a < 0 ? 0 : a > 180 ? 180 : a;
+    simAdvance(COST_PIN);
+    robotServoWrite(angle);
+}
+
+
+SimPort::operator uint8_t() const {
+    return robotEncoders();
+}
+
+SimCounter::operator uint16_t() const {
+    static const uint16_t prescalers[] = {0, 1, 8, 64, 256, 1024, 0, 0}; // External clock is not modelled
+    uint16_t prescaler = prescalers[TCCR1B & 0x07];
+    return prescaler ? simCycles / prescaler : 0;
+}
+
+/**
+ * Sends a byte through USART0; the data register is busy for one frame
+ * Bytes written while it is busy are taken at once (the shift register is not modelled)
+ */
+SimDataRegister &SimDataRegister::operator=(uint8_t c) {
+    uint64_t start = udr0Empty > simCycles ? udr0Empty : simCycles;
+    udr0Empty = start + uart0Frame();
+    if (capture)
+        fputc(c, capture);
+    return *this;
+}
+
+bool simReplay(const char *path) {
+    replay = fopen(path, "rb");
+    return replay != 0;
+}
+
+bool simCapture(const char *path) {
+    capture = fopen(path, "wb");
+    return capture != 0;
+}
+
+
+EEPROMClass::EEPROMClass() {
+    memset(eeprom, 0xFF, sizeof(eeprom));
+}
+
+uint8_t EEPROMClass::read(int a) {
+    simAdvance(COST_EEPROM_READ);
+    return a >= 0 && a < SIM_EEPROM_SIZE ? eeprom[a] : 0xFF;
+}
+
+void EEPROMClass::write(int a, uint8_t v) {
+    simAdvance(COST_EEPROM_WRITE);
+    if (a >= 0 && a < SIM_EEPROM_SIZE)
+        eeprom[a] = v;
+}
+
+bool simEepromLoad(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    size_t n = fread(eeprom, 1, sizeof(eeprom), f);
+    fclose(f);
+    return n == sizeof(eeprom);
+}
+
+bool simEepromSave(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    size_t n = fwrite(eeprom, 1, sizeof(eeprom), f);
+    fclose(f);
+    return n == sizeof(eeprom);
+}
+
+
+int HardwareSerial::available() {
+    return 0;
+}
+
+int HardwareSerial::read() {
+    return -1;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    simAdvance(COST_SERIAL);
+    if (simVerbose && port == 0)
+        putchar(c);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        write(buf[i]);
+    return n;
+}
+
+size_t HardwareSerial::print(const char *s) {
+    return write((const uint8_t *)s, strlen(s));
+}
+
+size_t HardwareSerial::print(char c) {
+    return write(c);
+}
+
+size_t HardwareSerial::print(int n, int base) {
+    return print((long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned int n, int base) {
+    return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(long n, int base) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", n);
+    return print(buf);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", n);
+    return print(buf);
+}
+
+size_t HardwareSerial::print(double n, int digits) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return print(buf);
+}
+
+size_t HardwareSerial::println() {
+    return print("\r\n");
+}
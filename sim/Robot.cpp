@@ -0,0 +1,282 @@
+/*
+    Description: Kinematic model of the bot for the arena simulator.
+
+    The base is square with one omni wheel on each side (see MotorDriver.h):
+    the front and back wheels drive sideways (body y), the left and right wheels drive forward (body x).
+    DIR LOW drives a wheel towards +x (left/right wheels) or +y (front/back wheels).
+    Wheel speed follows the PWM duty above a deadband, with a first order lag. Like real motors, no two
+    are alike: each has its own deadband, gain and curvature, so equal PWM makes the bot drift until calibrated.
+    The IR array turns on its servo about the centre of the base; sensor 0 is on its left end.
+    Each wheel has a quadrature encoder on port K, 2 pins per wheel in the order of the motors, which counts up
+    with DIR LOW. Wheels do not slip, so the encoders see the motion of the base exactly, but for their counts.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include "Sim.h"
+
+
+// Wiring, as declared in src/main.cpp
+extern int lfrPins[], servoPin, motorPins[4][2], throwShuttle, tunePin, bluePin;
+
+#define FRONT 0
+#define RIGHT 1
+#define BACK  2
+#define LEFT  3
+
+#define WHEEL_LAG    0.04  // Time constant of a wheel; s
+#define BASE_RADIUS  250   // Centre to wheel; mm
+#define SENSOR_PITCH 12.5  // Spacing of the IR sensors; mm
+#define SERVO_SPEED  600   // Degrees per second
+#define ANALOG_STEPS 16    // Samples of the line per sensor pitch for the analog position
+#define ANALOG_FULL  921   // ADC reading for a line under the last sensor; 4.5 V of 5 V
+#define ANALOG_NONE  1023  // ADC reading without a line
+#ifdef ODOMETRY
+#define ENCODER_STEP (ODOMETRY / 1000.0) // Wheel travel per count; mm
+#else
+#define ENCODER_STEP 0.393 // 100 mm wheels, 200 line encoders read on every edge
+#endif
+
+static double x, y, heading,       // Pose; mm, mm, radians
+              wheel[4],            // Wheel surface speed along its drive axis; mm/s
+              travel[4],           // Wheel surface travel since the start; mm
+              drive[4],            // Speed each wheel approaches at its PWM and DIR; mm/s
+              servoAngle = 90,     // Current and commanded servo angle; degrees
+              servoTarget = 90;
+static double noise = 0;           // Chance of a wrong digital IR reading
+static int pwm[4], dir[4],         // Last written PWM duty and DIR level of each motor
+           pinRole[SIM_PINS];      // What each pin drives; see below
+static bool lifted = false,        // Wheels spin freely; the base stays put
+            analogStale = true,    // Bot has moved since the analog position was found
+            tuneJumper = false,    // Tuning jumper grounded
+            blueJumper = false;    // Blue half jumper grounded
+
+// Speed of a motor at duty d: gain * (d - deadband) * ((d - deadband) / (255 - deadband)) ^ (curve - 1)
+static const struct {
+    int deadband;   // PWM duty below which the wheel does not turn
+    double gain,    // mm/s per PWM step above the deadband, near full duty
+           curve;   // 1 is linear; above 1 the wheel is slow at low duty
+} motorModel[4] = {
+    {20, 7.5, 1.0},
+    {28, 7.0, 1.15},
+    {16, 7.9, 0.9},
+    {24, 7.2, 1.1}
+};
+
+// pinRole values; the motor or sensor index is stored above the low 3 bits
+#define PIN_NONE   0
+#define PIN_PWM    1
+#define PIN_DIR    2
+#define PIN_IR     3
+#define PIN_THROW  4
+#define PIN_TUNE   5
+#define PIN_BLUE   6
+
+
+void robotInit() {
+    for (int i = 0; i < SIM_PINS; i++)
+        pinRole[i] = PIN_NONE;
+    for (int m = 0; m < 4; m++) {
+        pinRole[motorPins[m][0]] = PIN_PWM + m * 8;
+        pinRole[motorPins[m][1]] = PIN_DIR + m * 8;
+        pwm[m] = dir[m] = 0;
+        drive[m] = wheel[m] = 0;
+        travel[m] = 0;
+    }
+    for (int i = 0; i < 8; i++)
+        pinRole[lfrPins[i]] = PIN_IR + i * 8;
+    pinRole[throwShuttle] = PIN_THROW;
+    pinRole[tunePin] = PIN_TUNE;
+    pinRole[bluePin] = PIN_BLUE;
+
+    Point s = arenaStart();
+    x = s.x;
+    y = s.y;
+    heading = arenaStartHeading();
+}
+
+/**
+ * World position of IR sensor i; fractional i lies between the sensors
+ */
+static Point sensorPosition(double i) {
+    double facing = heading + (servoAngle - 90) * M_PI / 180, // Direction the array faces
+           offset = (3.5 - i) * SENSOR_PITCH;                 // Towards the left of the array
+    Point p = {x - offset * sin(facing), y + offset * cos(facing)};
+    return p;
+}
+
+/**
+ * Digital output of IR sensor i; flipped now and then with -noise
+ */
+static bool sensorOnLine(int i) {
+    bool on = arenaOnLine(sensorPosition(i));
+    return noise > 0 && rand() < noise * RAND_MAX ? !on : on;
+}
+
+/**
+ * Updates the speed a wheel approaches, after a write to its PWM or DIR pin
+ */
+static void setDrive(int m) {
+    double above = pwm[m] - motorModel[m].deadband,
+           span = 255 - motorModel[m].deadband;
+    drive[m] = above > 0 ? motorModel[m].gain * above * pow(above / span, motorModel[m].curve - 1) : 0;
+    if (dir[m])
+        drive[m] = -drive[m];
+}
+
+void robotStep(double dt) {
+    // Wheels approach the speed set by their drivers
+    for (int m = 0; m < 4; m++) {
+        wheel[m] += (drive[m] - wheel[m]) * (dt / (WHEEL_LAG + dt));
+        travel[m] += wheel[m] * dt;
+    }
+
+    // Least squares body velocity of the four omni wheels
+    double vx = (wheel[LEFT] + wheel[RIGHT]) / 2,
+           vy = (wheel[FRONT] + wheel[BACK]) / 2,
+           omega = (wheel[RIGHT] - wheel[LEFT] + wheel[FRONT] - wheel[BACK]) / (4 * BASE_RADIUS);
+
+    if (!lifted) {
+        x += (vx * cos(heading) - vy * sin(heading)) * dt;
+        y += (vx * sin(heading) + vy * cos(heading)) * dt;
+        heading += omega * dt;
+    }
+
+    // Servo turns towards the commanded angle
+    double step = SERVO_SPEED * dt;
+    if (fabs(servoTarget - servoAngle) <= step)
+        servoAngle = servoTarget;
+    else
+        servoAngle += servoTarget > servoAngle ? step : -step;
+
+    analogStale = true;
+}
+
+void robotPinWrite(int pin, int value) {
+    if (pin < 0 || pin >= SIM_PINS)
+        return;
+    int role = pinRole[pin] & 7, index = pinRole[pin] >> 3;
+    if (role == PIN_PWM) {
+        pwm[index] = value;
+        setDrive(index);
+    }
+    else if (role == PIN_DIR) {
+        dir[index] = value != 0;
+        setDrive(index);
+    }
+    else if (role == PIN_THROW && value)
+        simOnThrow();
+}
+
+int robotPinRead(int pin) {
+    if (pin >= 0 && pin < SIM_PINS && (pinRole[pin] & 7) == PIN_TUNE)
+        return tuneJumper ? 0 : 1;
+    if (pin >= 0 && pin < SIM_PINS && (pinRole[pin] & 7) == PIN_BLUE)
+        return blueJumper ? 0 : 1;
+    if (pin < 0 || pin >= SIM_PINS || (pinRole[pin] & 7) != PIN_IR)
+        return 0;
+    return sensorOnLine(pinRole[pin] >> 3) ? 1 : 0; // HIGH over the white line
+}
+
+/**
+ * Analog line position output of the IR array
+ * The middle of the line under the array, from 0 V at sensor 0 to 4.5 V at sensor 7, like the LSA08
+ */
+int robotAnalogRead(int channel) {
+    static int reading = ANALOG_NONE;
+    if (channel != 0)
+        return 0;
+    if (!analogStale)
+        return reading;
+
+    double sum = 0;
+    int count = 0;
+    for (int k = 0; k <= 7 * ANALOG_STEPS; k++)
+        if (arenaOnLine(sensorPosition((double)k / ANALOG_STEPS))) {
+            sum += k;
+            count++;
+        }
+
+    reading = count ? (int)(sum / count * ANALOG_FULL / (7 * ANALOG_STEPS) + 0.5) : ANALOG_NONE;
+    analogStale = false;
+    return reading;
+}
+
+int robotUartRead() {
+    int packed = 0;
+    for (int i = 0; i < 8; i++)
+        if (sensorOnLine(i))
+            packed |= 1 << i;
+    return packed;
+}
+
+void robotServoWrite(int angle) {
+    servoTarget = angle;
+}
+
+uint8_t robotEncoders() {
+    uint8_t pins = 0;
+    for (int m = 0; m < 4; m++) {
+        int phase = (long)floor(travel[m] / ENCODER_STEP) & 3;
+        pins |= (phase ^ phase >> 1) << 2 * m; // Gray code; A on the lower pin
+    }
+    return pins;
+}
+
+double robotEncoderDue() {
+    double due = HUGE_VAL;
+    for (int m = 0; m < 4; m++) {
+        if (wheel[m] == 0)
+            continue;
+        double q = travel[m] / ENCODER_STEP,
+               left = (wheel[m] > 0 ? floor(q) + 1 - q : q - floor(q)) * ENCODER_STEP;
+        if (left / fabs(wheel[m]) < due)
+            due = left / fabs(wheel[m]);
+    }
+    return due;
+}
+
+Point robotPosition() {
+    Point p = {x, y};
+    return p;
+}
+
+bool robotSeesLine() {
+    for (int i = 0; i < 8; i++)
+        if (arenaOnLine(sensorPosition(i)))
+            return true;
+    return false;
+}
+
+bool robotMoving() {
+    for (int m = 0; m < 4; m++)
+        if (pwm[m] > motorModel[m].deadband)
+            return true;
+    return false;
+}
+
+double robotWheelSpeed(int m) {
+    return wheel[m];
+}
+
+void robotLift(bool up) {
+    lifted = up;
+}
+
+void robotPlace(Point p, double h) {
+    x = p.x;
+    y = p.y;
+    heading = h;
+}
+
+void robotNoise(double p) {
+    noise = p;
+}
+
+void robotTuneJumper(bool grounded) {
+    tuneJumper = grounded;
+}
+
+void robotBlueJumper(bool grounded) {
+    blueJumper = grounded;
+}
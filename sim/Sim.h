@@ -0,0 +1,79 @@
+#ifndef SIM_H
+#define SIM_H
+
+/*
+  Shared state of the arena simulator.
+  Hal.cpp   - virtual clock, Timer2, ADC, USART and pin change emulation and the Arduino API
+  Robot.cpp - kinematics of the 4 omni wheel base, wheel encoders, IR array and servo
+  Arena.cpp - white lines and zones of the game field
+*/
+
+#include <stdint.h>
+
+
+#define SIM_PINS 70 // Digital pins on the Mega
+
+
+// Virtual clock; counts CPU cycles at F_CPU
+extern uint64_t simCycles;
+
+void simAdvance(uint32_t);      // Advances the clock; fires due interrupts and moves the bot. Parameter - cycles
+void simIdle();                 // Advances the clock upto the next timer interrupt
+double simSeconds();            // Virtual time in seconds
+void simRestart();              // Sets the clock back to 0, before setup()
+
+extern bool simVerbose;         // Echo Serial output to stdout
+bool simCapture(const char *);  // Saves bytes sent through USART0 to a file; Parameter - path
+bool simReplay(const char *);   // Feeds USART1 from a file instead of the IR array; Parameter - path
+bool simEepromLoad(const char *);       // Reads the EEPROM from a file; false if there is none
+bool simEepromSave(const char *);
+
+
+// Game field; all lengths in mm, origin at the bottom-left corner of the red side
+struct Point {
+  double x, y;
+};
+
+struct Segment {
+  Point a, b;
+};
+
+#define ARENA_SIZE 14000
+#define LINE_WIDTH 30
+#define MAX_TZ 3
+
+void arenaInit(bool blue);      // Builds the lines of the red or blue half
+bool arenaOnLine(Point);        // Checks if a point is on a white line
+Point arenaStart();             // Centre of the automatic robot starting zone
+double arenaStartHeading();     // Direction the bot faces at the start; radians
+Point arenaThrowingZone(int);   // Throwing position of TZ1 - TZ3
+Point arenaStraight();          // Start of the longest clear straight; the path down to the loading row
+double arenaStraightHeading();  // Direction along it; radians
+bool arenaInside(Point);        // Checks if a point is on the field
+
+
+// Robot
+void robotInit();               // Places the bot at the start and maps the pins used by src/main.cpp
+void robotStep(double);         // Integrates the motion; Parameter - seconds
+void robotPinWrite(int, int);   // Pin written by the program; Parameters - pin, value (0 - 255)
+int robotPinRead(int);          // Pin read by the program
+int robotAnalogRead(int);       // ADC reading of a channel; the IR array's line position output is on channel 0
+int robotUartRead();            // Reading the IR array sends on its UART; sensor bits, like the packed byte
+void robotServoWrite(int);      // Servo angle commanded by the program
+uint8_t robotEncoders();        // Quadrature states of the wheel encoders, as wired to port K
+double robotEncoderDue();       // Seconds until an encoder next changes at the present wheel speeds; HUGE_VAL if none turns
+Point robotPosition();
+bool robotSeesLine();           // Any sensor of the IR array is on a line
+bool robotMoving();             // Any wheel is driven
+double robotWheelSpeed(int);    // Surface speed of a wheel; mm/s, positive with DIR LOW
+void robotLift(bool);           // Lifts the bot off the field, or puts it back
+void robotPlace(Point, double); // Moves the bot; Parameters - position, heading
+void robotTuneJumper(bool);     // Grounds the tuning jumper, or leaves it open (HIGH with the pull-up)
+void robotBlueJumper(bool);     // Grounds the jumper which selects the blue half
+void robotNoise(double);        // Chance of each digital IR reading being wrong, as from glare or tape seams
+
+
+// Events reported to the simulator
+void simOnThrow();              // Throw signal went high
+
+#endif
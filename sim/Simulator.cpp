@@ -0,0 +1,254 @@
+/*
+    Description: Arena simulator for the line following system.
+    Runs setup() and loop() from src/main.cpp unmodified against the simulated field,
+    on a virtual clock, and reports the time taken to reach each throwing zone.
+
+    Usage: program [-blue] [-throws N] [-time S] [-telemetry FILE] [-eeprom FILE] [-calibrate] [-tune] [-lsa08 FILE] [-noise P] [-v]
+        -blue       Start from the blue half
+        -throws N   Stop after N throws (default 8)
+        -time S     Match length in seconds (default 180)
+        -telemetry FILE
+                    Save the bytes sent through USART0; decode with tools/telemetry_decode.cpp
+        -eeprom FILE
+                    EEPROM contents; loaded at start if the file exists, saved at exit. If it holds no motor
+                    calibration, the motors are measured before the run, as with -calibrate
+        -calibrate  Measure the motor calibration with the bot lifted, print it and save it to EEPROM,
+                    instead of running a match
+        -tune       Boot with the tuning jumper grounded on the path down to the loading row, print the
+                    tuned gain schedule and save it to EEPROM, instead of running a match
+        -lsa08 FILE Feed the IR array's UART (builds with LFR_UART) from a file instead of the field,
+                    e.g. the output of tools/lsa08_stream.cpp
+        -noise P    Chance of each digital IR reading being wrong (default 0)
+        -v          Echo Serial output
+*/
+
+#include <Arduino.h>
+#include <MotorDriver.h>
+#include <GainBand.h>
+#include <stdio.h>
+#include "Sim.h"
+
+
+#define MAX_THROWS 64
+#define LOOP_COST  200 // Cycles of loop() overhead in the Arduino core
+#define LOST_TIME  1.0 // Seconds without seeing a line while driving before the bot counts as lost
+#define LOOK_TIME  0.001 // Seconds between the simulator's own checks for the line; the IR array is read as the program reads it
+#define TUNE_TIME  30  // Seconds allowed for tuning all bands
+#define TUNE_IDLE  0.5 // Seconds standing still after which tuning counts as done
+
+void setup();
+void loop();
+
+extern Motors motor;
+extern GainBand tuned[];
+extern byte tuneBand;
+
+struct Throw {
+    double time;
+    int tz;   // Nearest throwing zone
+    double miss; // Distance from its throwing position; mm
+};
+
+static Throw throws[MAX_THROWS];
+static int totalThrows = 0;
+
+static const MotorCalibration uncalibrated[4] PROGMEM = {MOTOR_CAL_IDENTITY, MOTOR_CAL_IDENTITY, MOTOR_CAL_IDENTITY, MOTOR_CAL_IDENTITY};
+
+
+/**
+ * Records a throw at the throwing zone nearest to the bot
+ */
+void simOnThrow() {
+    if (totalThrows == MAX_THROWS)
+        return;
+
+    Point p = robotPosition();
+    Throw &t = throws[totalThrows++];
+    t.time = simSeconds();
+    t.tz = 1;
+    t.miss = 1e9;
+    for (int tz = 1; tz <= MAX_TZ; tz++) {
+        Point c = arenaThrowingZone(tz);
+        double d = hypot(p.x - c.x, p.y - c.y);
+        if (d < t.miss) {
+            t.miss = d;
+            t.tz = tz;
+        }
+    }
+}
+
+/**
+ * Prints the time taken for each leg, and the mean per throwing zone
+ */
+static void report() {
+    double sum[MAX_TZ + 1] = {0}, last = 0;
+    int count[MAX_TZ + 1] = {0};
+
+    printf("%-6s %-4s %10s %10s %10s\n", "Throw", "TZ", "At (s)", "Lap (s)", "Miss (mm)");
+    for (int i = 0; i < totalThrows; i++) {
+        double lap = throws[i].time - last;
+        printf("%-6d %-4d %10.3f %10.3f %10.0f\n", i + 1, throws[i].tz, throws[i].time, lap, throws[i].miss);
+        sum[throws[i].tz] += lap;
+        count[throws[i].tz]++;
+        last = throws[i].time;
+    }
+
+    printf("\n%-4s %6s %12s\n", "TZ", "Throws", "Mean lap (s)");
+    for (int tz = 1; tz <= MAX_TZ; tz++)
+        if (count[tz])
+            printf("%-4d %6d %12.3f\n", tz, count[tz], sum[tz] / count[tz]);
+}
+
+static float wheelSpeed(int m) {
+    return robotWheelSpeed(m);
+}
+
+/**
+ * Runs MotorDriver::calibrate() against the wheel model, which saves the result to EEPROM
+ */
+static void measure() {
+    robotLift(true);
+    motor.calibrate(wheelSpeed);
+    robotLift(false);
+}
+
+/**
+ * Measures the motors and prints the result as a PROGMEM table
+ */
+static void calibrate() {
+    measure();
+
+    printf("const MotorCalibration motorCal[4] PROGMEM = {\n");
+    for (int m = 0; m < 4; m++) {
+        const MotorCalibration &c = motor.getCalibration(m);
+        printf("    {%d, %d, {", c.deadband, c.gain);
+        for (int k = 0; k < CAL_POINTS; k++)
+            printf(k ? ", %d" : "%d", c.curve[k]);
+        printf("}}%s\n", m < 3 ? "," : "");
+    }
+    printf("};\n");
+}
+
+/**
+ * Prints the schedule left by a tuning run, in the form of gainSchedule in src/main.cpp
+ */
+static void reportTuning() {
+    printf("const GainBand gainSchedule[] = {\n    // Volt, kP, kI, kD\n");
+    for (int i = 0; i < tuneBand; i++)
+        printf("    {%3d, %.3g, %.3g, %.3g}%s\n", tuned[i].volt, tuned[i].kP, tuned[i].kI, tuned[i].kD,
+               i < tuneBand - 1 ? "," : "");
+    printf("};\n");
+}
+
+int main(int argc, char *argv[]) {
+    bool blue = false, calibration = false, tuning = false;
+    const char *eepromFile = 0;
+    int maxThrows = 8;
+    double matchTime = 180;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-blue"))
+            blue = true;
+        else if (!strcmp(argv[i], "-throws") && i + 1 < argc)
+            maxThrows = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-time") && i + 1 < argc)
+            matchTime = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-telemetry") && i + 1 < argc) {
+            if (!simCapture(argv[++i])) {
+                perror(argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-lsa08") && i + 1 < argc) {
+            if (!simReplay(argv[++i])) {
+                perror(argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-noise") && i + 1 < argc)
+            robotNoise(atof(argv[++i]));
+        else if (!strcmp(argv[i], "-eeprom") && i + 1 < argc)
+            eepromFile = argv[++i];
+        else if (!strcmp(argv[i], "-calibrate"))
+            calibration = true;
+        else if (!strcmp(argv[i], "-tune"))
+            tuning = true;
+        else if (!strcmp(argv[i], "-v"))
+            simVerbose = true;
+        else {
+            fprintf(stderr, "Usage: %s [-blue] [-throws N] [-time S] [-telemetry FILE] [-eeprom FILE] [-calibrate] [-tune] [-lsa08 FILE] [-noise P] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (eepromFile)
+        simEepromLoad(eepromFile);
+
+    arenaInit(blue);
+    robotInit();
+    robotBlueJumper(blue);
+
+    if (calibration) {
+        calibrate();
+        if (eepromFile)
+            simEepromSave(eepromFile);
+        return 0;
+    }
+
+    // A bot that was never calibrated drives on the identity table, which the simulated motors do not fit.
+    // Measure them first, as on the bench, then start from time 0 with the bot back at rest.
+    if (!motor.loadCalibration(uncalibrated)) {
+        measure();
+        robotInit();
+    }
+    simRestart();
+
+    if (tuning) {
+        robotPlace(arenaStraight(), arenaStraightHeading());
+        robotTuneJumper(true);
+        matchTime = TUNE_TIME;
+    }
+
+    setup();
+
+    const char *result = "Match time over";
+    double lineSeen = 0, looked = 0, moved = 0;
+    while (true) {
+        loop();
+        simAdvance(LOOP_COST);
+
+        double now = simSeconds();
+        if (now - looked >= LOOK_TIME) {
+            looked = now;
+            if (robotSeesLine() || !robotMoving())
+                lineSeen = now;
+        }
+
+        if (robotMoving())
+            moved = now;
+        if (tuning && now - moved > TUNE_IDLE) {
+            result = "Tuning done";
+            break;
+        }
+        if (totalThrows >= maxThrows) {
+            result = "Throws done";
+            break;
+        }
+        if (now >= matchTime)
+            break;
+        if (now - lineSeen > LOST_TIME || !arenaInside(robotPosition())) {
+            result = "Bot lost the line";
+            break;
+        }
+    }
+
+    Point p = robotPosition();
+    printf("%s at %.3f s; bot at (%.0f, %.0f) mm\n\n", result, simSeconds(), p.x, p.y);
+    if (tuning)
+        reportTuning();
+    else
+        report();
+    if (eepromFile)
+        simEepromSave(eepromFile);
+    return 0;
+}
@@ -0,0 +1,182 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/*
+  Host-side stand-in for the Arduino core and the AVR headers it pulls in.
+  Only what the bot's code uses is provided. Every call costs virtual CPU time (see Hal.cpp),
+  so polling loops advance the simulated clock, and Timer2 interrupts fire in between.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define PI 3.1415926535897932384626433832795
+
+#define DEC 10
+#define HEX 16
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+
+// avr/pgmspace.h
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define memcpy_P memcpy
+
+
+// avr/interrupt.h; vectors the simulator services are declared weak in Hal.cpp
+#define ISR(vector) void vector()
+
+void cli();
+void sei();
+
+
+// avr/io.h; registers are plain variables, Timer1, Timer2, the ADC, the USART0 transmitter, the USART1 receiver
+// and the pin change interrupt of port K are emulated from them
+#define _BV(bit) (1 << (bit))
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2;
+
+#define WGM20  0
+#define WGM21  1
+#define CS20   0
+#define CS21   1
+#define CS22   2
+#define OCIE2A 1
+
+// Timer1 counts the virtual clock
+struct SimCounter {
+  operator uint16_t() const;
+};
+
+extern volatile uint8_t TCCR1A, TCCR1B;
+extern SimCounter TCNT1;
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+
+// ADC; only free-running conversions with the interrupt are emulated
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+extern volatile uint16_t ADC;
+
+#define REFS0 6
+#define MUX5  3
+#define ADEN  7
+#define ADSC  6
+#define ADATE 5
+#define ADIF  4
+#define ADIE  3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+
+// Writes to UDR0 go out on the virtual wire; nothing is ever received
+struct SimDataRegister {
+  SimDataRegister &operator=(uint8_t);
+  operator uint8_t() const { return 0; }
+};
+
+extern volatile uint8_t UCSR0A, UCSR0B, UCSR0C;
+extern volatile uint16_t UBRR0;
+extern SimDataRegister UDR0;
+
+#define U2X0   1
+#define RXC0   7
+#define UDRE0  5
+#define UCSZ00 1
+#define UCSZ01 2
+#define TXEN0  3
+#define RXEN0  4
+#define UDRIE0 5
+#define RXCIE0 7
+
+// USART1 receives from the IR array; UDR1 holds the byte while ISR(USART1_RX_vect) runs
+extern volatile uint8_t UCSR1A, UCSR1B, UCSR1C, UDR1;
+extern volatile uint16_t UBRR1;
+
+#define U2X1   1
+#define UCSZ10 1
+#define UCSZ11 2
+#define RXEN1  4
+#define RXCIE1 7
+
+// Port K reads the wheel encoders; ISR(PCINT2_vect) runs when a pin enabled in PCMSK2 changes
+struct SimPort {
+  operator uint8_t() const;
+};
+
+extern volatile uint8_t DDRK, PORTK, PCICR, PCMSK2;
+extern SimPort PINK;
+
+#define PCIE2 2
+
+
+// Arduino API
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+void analogWrite(uint8_t, int);
+int analogRead(uint8_t);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+void yield();
+
+
+class HardwareSerial {
+
+private:
+  int port; // 0 for Serial, 1 for Serial1
+
+public:
+  HardwareSerial(int p) : port(p) {}
+
+  void begin(unsigned long) {}
+  void end() {}
+  int available();
+  int read();
+  void flush() {}
+
+  size_t write(uint8_t);
+  size_t write(const uint8_t *, size_t);
+  size_t print(const char *);
+  size_t print(char);
+  size_t print(int, int = DEC);
+  size_t print(unsigned int, int = DEC);
+  size_t print(long, int = DEC);
+  size_t print(unsigned long, int = DEC);
+  size_t print(double, int = 2);
+  size_t println();
+
+  template <typename T>
+  size_t println(T value) { return print(value) + println(); }
+
+  template <typename T>
+  size_t println(T value, int format) { return print(value, format) + println(); }
+
+  operator bool() { return true; }
+};
+
+extern HardwareSerial Serial, Serial1;
+
+#endif
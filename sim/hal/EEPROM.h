@@ -0,0 +1,42 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+/*
+  Host-side EEPROM; 4 KB as on the Mega, erased (0xFF) at start.
+  Writes cost the 3.3 ms of a real EEPROM write in virtual time.
+*/
+
+#include <Arduino.h>
+
+
+#define SIM_EEPROM_SIZE 4096
+
+class EEPROMClass {
+
+public:
+  EEPROMClass();
+  uint8_t read(int);
+  void write(int, uint8_t);
+  void update(int a, uint8_t v) { if (read(a) != v) write(a, v); }
+  uint16_t length() { return SIM_EEPROM_SIZE; }
+
+  template <typename T>
+  T &get(int a, T &t) {
+    uint8_t *p = (uint8_t *)&t;
+    for (unsigned int i = 0; i < sizeof(T); i++)
+      p[i] = read(a + i);
+    return t;
+  }
+
+  template <typename T>
+  const T &put(int a, const T &t) {
+    const uint8_t *p = (const uint8_t *)&t;
+    for (unsigned int i = 0; i < sizeof(T); i++)
+      update(a + i, p[i]);
+    return t;
+  }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SERVO_H
+#define SERVO_H
+
+/*
+  Host-side stand-in for the Servo library.
+  The commanded angle is passed to the simulated IR array, which turns towards it at the servo's speed.
+*/
+
+#include <stdint.h>
+
+
+class Servo {
+
+private:
+  int pin, angle;
+
+public:
+  Servo() : pin(-1), angle(90) {}
+
+  uint8_t attach(int p) { pin = p; return 0; }
+  void detach() { pin = -1; }
+  bool attached() { return pin >= 0; }
+  void write(int);                  // Defined in Hal.cpp
+  int read() { return angle; }      // Last commanded angle, as in the Arduino library
+};
+
+#endif
@@ -4,16 +4,37 @@
     Description: Line following system for the Robocon project.
 */
 
+#define LFR_PINS 40, 41, 42, 43, 44, 45, 46, 47  // IR array pins; wiring is known at compile time for port reads
+#define ROUTE_ZONES 6  // Zones of the arena graph
+#define ROUTE_NODES 7  // Zones and the first turn
+
 #include <Arduino.h>
 #include <LineDetector.h>
 #include <MotorDriver.h>
 #include <PIDController.h>
+#include <ControlLoop.h>
+#include <Scheduler.h>
+#include <Telemetry.h>
+#include <AutoTuner.h>
+#include <RoutePlanner.h>
+#include <MissionPlanner.h>
+#include <Odometry.h>
 
 
 #define MAX_TZ3 5   // Maximum throws allowed through TZ3
+#define MATCH_TIME 180000UL // Time (ms) from reset to the end of the match
+#define THROW_TIME 1000 // Time (ms) the throw signal is held for the main board
+#define TELEMETRY_BAUD 115200
+#define TELEMETRY_EVERY 10  // Control ticks per telemetry record; 100 records/s fit in the link at 1 kHz
+#define COMMAND_POLL 100    // Time (ms) between checks for commands from the host
+#define TUNE_VOLT 80        // Tuning voltage of the lowest band, which starts at 0 V
+#define TUNE_RELAY 100      // Lateral voltage of the relay while tuning; weaker relays lose the line at speed
+#define FILTER_SPAN 2000    // Junction filter window (ticks) times voltage; ~14 mm of travel at any speed
+#define MAX_GAIN 127        // Largest gain the Q8.8 PID holds, per step of the finest deviation
+#define BASE_RADIUS 250     // Centre of the base to a wheel; mm
 
 
-int lfrPins[] = {40, 41, 42, 43, 44, 45, 46, 47}, // IR array pins
+int lfrPins[] = {LFR_PINS},                       // IR array pins
     servoPin = 31,                                // IR servo pin
     motorPins[4][2] = {
         // Motor pins
@@ -22,150 +43,377 @@ int lfrPins[] = {40, 41, 42, 43, 44, 45, 46, 47}, // IR array pins
         {3, 24}, // Back
         {4, 26}  // Left
 },
-    lagVolt[2][2] = {{0, 0}, {0, 0}}, // Lag in motors as {{Pin, Lag}, {Pin, Lag}}
-    throwShuttle = 0,       // Pin to send signal to the main board for throwing the shuttle
-    tz = 1,        // Throwing zone to move to
-    tz3Throws = 0; // Total throws through TZ3
+    throwShuttle = 33,      // Pin to send signal to the main board for throwing the shuttle
+    tunePin = 30,           // Jumper to ground at reset tunes the PID on the line ahead instead of playing
+    bluePin = 32;           // Jumper to ground at reset plays from the blue half
+
+// PWM calibration used until one is measured (sim -calibrate, or MotorDriver::calibrate() on the bench) and saved to EEPROM
+const MotorCalibration motorCal[4] PROGMEM = {MOTOR_CAL_IDENTITY, MOTOR_CAL_IDENTITY, MOTOR_CAL_IDENTITY, MOTOR_CAL_IDENTITY};
 
-MotorDriver motor(motorPins, lagVolt);
+Motors motor(motorPins);
 LineDetector lfr(lfrPins);
-PIDController pid(13, 0, 5);
+PIDController pid(13, 0, 5); // Gains are per tick at CONTROL_HZ; replaced by the schedule in setup()
+ControlLoop control(lfr, motor, pid);
+Scheduler tasks;
+Telemetry telemetry; // Binary records on USART0; decode with tools/telemetry_decode.cpp
+AutoTuner tuner;
+RoutePlanner route;
+MissionPlanner planner(route);
+#ifdef ODOMETRY
+Odometry odometry(ODOMETRY, BASE_RADIUS); // Wheel encoders on A8 - A15; build with -D ODOMETRY=<um per count>
+#endif
+
+// PID gains per straight line voltage; each band holds from its voltage up to the next one's
+// Softer proportional and more damping at speed
+// Used until a tuning run saves its own schedule to EEPROM
+const GainBand gainSchedule[] = {
+    // Volt, kP, kI, kD
+    {0,   13, 0, 5},
+    {140, 11, 0, 8},
+    {200,  9, 0, 11}
+};
+
+// Straights ramp from the segment voltage upto 220 in ~0.5 s, and back off by 1 V per tick per unit of deviation
+// Once the next cross-section is the last of the segment, the bot brakes back down by 1 V per tick
+const SpeedProfile speedProfile = {220, 64, 256, 1, 256};
+
+// Motor voltage changes by at most 0.75 V per tick, reached over 40 ticks; 0 to 80 V takes ~0.15 s
+const MotionProfile motionProfile = {192, 5};
+
+/*
+  Arena graph, on the red half; see img/Arena.png.
+  Zones are the places the mission moves between; the bot only stops at the other nodes to turn.
+*/
+enum Node {
+    START_ZONE,     // Cross-section in the starting zone
+    LOADING_1,      // Loading point on the row of TZ1
+    LOADING_2,      // Loading point on the row of TZ2 and TZ3
+    TZ_1,
+    TZ_2,
+    TZ_3,
+    CORNER          // First turn, below the starting zone
+};
+
+const RouteEdge arena[] PROGMEM = {
+    // From, to, heading, junctions (cross-sections or the corner), mm
+    {START_ZONE, CORNER,    EAST,  1,  545},
+    {CORNER,     LOADING_1, SOUTH, 1, 4500},
+    {LOADING_1,  LOADING_2, SOUTH, 1, 2005},
+    {LOADING_1,  TZ_1,      EAST,  2, 2690}, // Over the mark before TZ1
+    {LOADING_2,  TZ_2,      EAST,  2, 2690}, // Over the mark before TZ2
+    {TZ_2,       TZ_3,      EAST,  3, 3275}  // Over the marks after TZ2 and before TZ3
+};
+
+// Heading at each zone; the shuttle is handed over with the bot facing away from the throwing zones
+const byte zoneFacing[ROUTE_ZONES] = {EAST, WEST, WEST, EAST, EAST, EAST};
+
+// What a throw is worth; update the chances from the team's throwing practice
+const ThrowZone throwZones[] = {
+    // Zone, loading point, expected points, throws allowed, zone thrown first
+    {TZ_1, LOADING_1,  9, 0,       0}, // 10 points, 9 in 10 go through
+    {TZ_2, LOADING_2, 12, 0,       0}, // 15 points, 4 in 5; after TZ1
+    {TZ_3, LOADING_2, 52, MAX_TZ3, 1}  // 20 points, 3 in 5; landing in the golden cup wins the round,
+                                        // counted as 200 points at 1 in 5; after TZ2
+};
+
+/*
+  Mission states.
+  Each state starts its action on entry and is left when its event (cross-section, timer, settled servo) occurs;
+  nothing blocks, so the scheduler keeps running tasks while the bot waits.
+  The bot moves between zones along the routes planned in setup(), one leg at a time. A leg starts on the
+  cross-section where the last one ended; it only counts the ones it reaches.
+*/
+enum MissionState {
+    TURN,           // Turning onto the next leg of the route
+    FOLLOW,         // Following the line over the cross-sections of a leg, upto the last
+    THROW,          // Throw signal is high; bot waits at the throwing zone
+    TUNE,           // Tuning the PID of one gain band; bot on a long straight line
+    TUNED           // Tuned schedule saved; bot stopped
+};
+
+#define BANDS (sizeof(gainSchedule) / sizeof(*gainSchedule))
+#define EDGES (sizeof(arena) / sizeof(*arena))
+#define THROW_ZONES (sizeof(throwZones) / sizeof(*throwZones))
+
+MissionState state;             // Current state
+unsigned long stateStart;       // Time at which the current state was entered
+byte here = START_ZONE,         // Zone the route starts from
+     target,                    // Zone the route goes to
+     legIndex,                  // Next leg of the route
+     leg,                       // Leg being driven
+     nextThrow;                 // Throwing zone of the shuttle; index into throwZones
+unsigned long routeStart;       // Time at which the route was started
+bool throwing = false;          // Throw signal is high
+GainBand tuned[BANDS];          // Schedule being tuned
+byte tuneBand;                  // Band being tuned
 
 
 // Function declarations
-void moveForward(int = 80); // Moves the bot in forward direction
-void moveToTZ();    // Moves the bot to/from throwing zone
+void moveForward(int = 80, byte = 1, unsigned int = 0); // Starts moving the bot in forward direction
+void go(byte);              // Starts the route to a zone
+void nextLeg();             // Starts the next leg of the route, or ends it
+void arrive();              // Acts on reaching the end of the route
+void planThrow();           // Picks the throwing zone for the next shuttle and moves to its loading point
+void enter(MissionState);   // Enters a state and starts its action
+void runMission();          // Checks the event of the current state
+void endThrow();            // Drops the throw signal
+void serveCommands();       // Answers commands sent over the telemetry link
+void tuneNext();            // Keeps the gains of the finished band and tunes the next one
 
 
 /**
- * Function responsible for bot's movement upto Loading zone 1.
+ * Function responsible for initializing the bot.
+ * Plans the routes for the half the bot starts from, starts the match clock and the route to loading point 1:
  * Start form ARS.
- * Move forward until first right turn.
- * Turn and continue moving forward until a cross-section is detected.
+ * Move forward until the first turn, turn and move until the loading cross-section.
  * On reaching cross-section turn away from throwing zone.
  */
 void setup() {
     // Starting from ARS zone
     
     lfr.initServo(servoPin);
+    lfr.setFilter(FILTER_SPAN);
+#ifdef LFR_ANALOG
+    lfr.beginAnalog(); // Line position from the analog output; build with -D LFR_ANALOG=<ADC channel>
+#endif
+#ifdef LFR_UART
+    lfr.beginUart();   // Readings streamed on RX1; build with -D LFR_UART=<baud>
+#endif
+    motor.loadCalibration(motorCal);
+    motor.setProfile(motionProfile);
+    control.loadSchedule(gainSchedule, BANDS);
+    control.setSpeedProfile(speedProfile);
+#ifdef ODOMETRY
+    odometry.begin();
+    control.setOdometry(&odometry); // Brakes and clears cross-sections by distance
+#endif
+#ifdef PROFILE
+    telemetry.begin(TELEMETRY_BAUD, true); // Profile is queried over the link
+    tasks.every(COMMAND_POLL, serveCommands);
+    Profiler::begin();
+#else
+    telemetry.begin(TELEMETRY_BAUD);
+#endif
+    control.setTelemetry(&telemetry, TELEMETRY_EVERY);
+    control.begin(); // Start the fixed-rate control loop
 
-    // Move ahead of starting cross-section
-    motor.move('f', 100);
-    delay(500);
+    pinMode(throwShuttle, OUTPUT);
 
-    moveForward(); // Move forward until first turn
-    motor.turn('r'); // First turn is right
-    lfr.rotate('r'); // Rotate the IR array
-    moveForward(); // Continue
+    pinMode(bluePin, INPUT_PULLUP);
+    route.plan(arena, EDGES, zoneFacing, digitalRead(bluePin) == LOW);
+    planner.begin(throwZones, THROW_ZONES, MATCH_TIME, THROW_TIME);
 
-    // First loading point reached
-    motor.turn('r'); // TZ1 on left; Face away
-    lfr.rotate('r');
+    pinMode(tunePin, INPUT_PULLUP);
+    if (digitalRead(tunePin) == LOW) {
+        tuneBand = 0;
+        enter(TUNE);
+    }
+    else
+        planThrow(); // TZ1; the only zone the rules allow first
 }
 
 /**
- * Function responsible for movement for remaining of the game.
- * Rotate back to face the throwing zone.
+ * Runs the scheduled tasks and the mission state machine; never blocks.
+ * After the loading point is reached the mission repeats:
  * Move to the throwing zone, throw shuttle.
- * Move back to loading point.
- * Update throwing zone information.
- * Repeat.
+ * Pick the throwing zone of the next shuttle from the match time left.
+ * Move to its loading point.
  */
 void loop() {
-    // Bot at loading cross-section
+    tasks.run();
+    runMission();
+}
+
+/**
+ * Enters a state and starts the action associated with it
+ * @param MissionState s    The state to enter
+ */
+void enter(MissionState s) {
+    state = s;
+    stateStart = millis();
+    telemetry.setState(s);
 
-    // After recieving shuttle
-    motor.turn('b'); // Face towards the throwing zone
-    lfr.rotate('b'); // Also rotate the IR array
+    switch (s) {
+        case TURN:
+            motor.turn(legTurn(leg));  // Re-assigns the motors to the new heading
+            lfr.rotate(legTurn(leg));  // Rotate the IR array
+            break;
 
-    moveToTZ();      // Bot moves to throwing zone
+        case FOLLOW:
+            // Passes the cross-sections on the way, and stops at the last
+            moveForward(80, legJunctions(leg), route.legLength(here, target, legIndex - 1));
+            break;
 
-    // Reached TZ
-    // Throw shuttle
-    digitalWrite(throwShuttle, HIGH);
-    delay(1000); // Wait for signal to be read
-    digitalWrite(throwShuttle, LOW);
+        case THROW:
+            // Reached TZ
+            // Throw shuttle
+            throwing = true;
+            digitalWrite(throwShuttle, HIGH);
+            tasks.after(THROW_TIME, endThrow); // Wait for signal to be read
+            break;
 
-    // After completing thorw
-    // Return to cross-section for loading
-    motor.turn('b'); // Face towards loading zone
-    lfr.rotate('b');
-    moveToTZ();      // Bot goes back to loading cross-section
-
-    // Throwing zone specific conditions
-    if (tz == 1)
-    {
-        // Bot is at loading zone 1
-        // And has cleared the first throwing zone
-        // Move it to second loading zone
-        motor.turn('l'); // Face towards the next loading cross-section
-        lfr.rotate('l');
-        moveForward();   // Move until loading cross-section is reached
-        motor.turn('r'); // Face away from the throwing zone
-        lfr.rotate('r');
-
-        tz = 2; // Next throw from TZ2
+        case TUNE:
+            // The lowest band starts at 0 V; tune it at the usual segment voltage
+            tuned[tuneBand] = gainSchedule[tuneBand];
+            control.tune(gainSchedule[tuneBand].volt ? gainSchedule[tuneBand].volt : TUNE_VOLT, tuner, TUNE_RELAY);
+            break;
+
+        case TUNED:
+            motor.stop();
+            control.saveSchedule(tuned, BANDS);
+            control.setSchedule(tuned, BANDS);
+            break;
     }
-    else if (tz == 2 && tz3Throws != MAX_TZ3)
-        // TZ2 complete
-        // TZ3 throws available
-        tz = 3;
-    else if (tz == 3)
-    {
-        tz3Throws++;
-        if (tz3Throws == MAX_TZ3)
-            // No more TZ3 throws available
-            tz = 2; // Continue throwing from second TZ
+}
+
+/**
+ * Checks if the event which ends the current state has occured, and moves to the next state
+ */
+void runMission() {
+    switch (state) {
+        case TURN:
+            if (lfr.isReady()) {
+                if (legJunctions(leg))
+                    enter(FOLLOW);
+                else
+                    nextLeg(); // Turn only; the bot faces the way the zone needs
+            }
+            break;
+
+        case FOLLOW:
+            if (control.isReached())
+                nextLeg();
+            break;
+
+        case THROW:
+            // After completing thorw
+            // Move to the loading point of the next throw
+            if (!throwing) {
+                planner.thrown(nextThrow);
+                planThrow();
+            }
+            break;
+
+        case TUNE:
+            if (control.isReached())
+                tuneNext();
+            break;
+
+        case TUNED:
+            break;
     }
 }
 
 /**
- * Function moves the bot in a straight line until a turn of cross-section is detected
- * @param int stdVolt   The standard voltage which is applied to move straight
+ * Function starts moving the bot in a straight line until a turn of cross-section is detected
+ * Line following runs in the control loop interrupt, which raises the cross-section event
+ * @param int          stdVolt    The standard voltage which is applied to move straight
+ * @param byte         junctions  Cross-sections to pass; the bot stops at the last one
+ * @param unsigned int length     Line upto the last one; mm, 0 if not known
  */
-void moveForward(int stdVolt) {
-    int error, volt;
-
-    // Loop until a cross-section or turn is detected
-    do {
-        error = lfr.calcDeviation(); // Calculate the deviation
-        volt = pid.calcVolt(error);  // Calculate the voltage requierd to fix error
-
-        if (error < 0) {
-            // Adjust to right
-            motor.move('r', volt, true);
-        }
-        else if (error > 0) {
-            // Adjust to left
-            motor.move('l', volt, true);
-        }
-        else {
-            // Move straight
-            motor.move('f', stdVolt);
-        }
-    } while (!lfr.isCrossSection());
-
-    motor.stop(); // Stop bot movement
+void moveForward(int stdVolt, byte junctions, unsigned int length) {
+    control.follow(stdVolt, junctions, length);
 }
 
 
 /**
- * Throwing zone is detected by a cross-section.
- * Each throwing zone is surrounded by one additional cross-section on each side.
- * This cross-sections must be skipped.
- * Check the arena configuration to know how the number of skips are calculated.
+ * Starts the route from the current zone to another
+ * Routes are looked up from the tables planned in setup(); nothing is worked out while moving.
+ * @param byte zone The zone to move to
+ */
+void go(byte zone) {
+    target = zone;
+    legIndex = 0;
+    routeStart = millis();
+    nextLeg();
+}
+
+/**
+ * Starts the next leg of the route: turns first if the leg needs it, else follows the line at once
+ * After the last leg the bot is at the target zone
+ */
+void nextLeg() {
+    if (legIndex == route.legs(here, target)) {
+        arrive();
+        return;
+    }
+
+    leg = route.leg(here, target, legIndex++);
+    if (legTurn(leg) != 'f')
+        enter(TURN);
+    else
+        enter(FOLLOW);
+}
+
+/**
+ * Throws at a throwing zone; at a loading point, moves on to the throwing zone picked for the shuttle
+ */
+void arrive() {
+    planner.measured(here, target, millis() - routeStart); // Later picks use the time this route took
+    here = target;
+    if (here >= TZ_1)
+        enter(THROW);
+    else
+        go(throwZones[nextThrow].zone);
+}
+
+/**
+ * Picks the throwing zone which gives the most expected points in the match time left, and moves to its
+ * loading point
+ * Takes a fraction of a millisecond; the bot does not wait for it.
+ */
+void planThrow() {
+    int i = planner.pick(here);
+    if (i < 0) {
+        motor.stop(); // Nothing left to throw at
+        return;
+    }
+    nextThrow = i;
+    go(throwZones[i].loading);
+}
+
+/**
+ * Keeps the gains measured for the band just tuned, and moves on to the next band
+ * The bot keeps following the line at the new voltage, so the straight must be long enough for all bands.
+ * A band whose run failed keeps its gains from the built-in schedule.
+ */
+void tuneNext() {
+    float kP, kI, kD;
+    if (tuner.gains(kP, kI, kD)) {
+        // Schedule gains are per step of the digital deviation
+        tuned[tuneBand].kP = (kP < MAX_GAIN ? kP : MAX_GAIN) * LineDetector::RESOLUTION;
+        tuned[tuneBand].kI = (kI < MAX_GAIN ? kI : MAX_GAIN) * LineDetector::RESOLUTION;
+        tuned[tuneBand].kD = (kD < MAX_GAIN ? kD : MAX_GAIN) * LineDetector::RESOLUTION;
+    }
+
+    if (++tuneBand < BANDS)
+        enter(TUNE);
+    else
+        enter(TUNED);
+}
+
+/**
+ * Task which drops the throw signal once the main board has read it
+ */
+void endThrow() {
+    digitalWrite(throwShuttle, LOW);
+    throwing = false;
+}
+
+#ifdef PROFILE
+/**
+ * Task which answers the host on the telemetry link
+ * Sends the cycle counts of the control loop
  */
-void moveToTZ() {
-    int skips;
-    if (tz == 1 || tz == 2)
-        skips = 2;
-    else if (tz == 3)
-        skips = 5;
-
-    while (skips) {
-        moveForward();
-        skips--;
-        motor.move('f', 255);
-        delay(500);
+void serveCommands() {
+    int command = telemetry.read();
+    ProfileRecord r;
+    if (command == TELEMETRY_PROFILE) {
+        for (byte s = 0; s < PROFILE_SECTIONS; s++)
+            if (Profiler::report(s, r))
+                telemetry.send(&r, sizeof(r));
     }
+    else if (command == TELEMETRY_PROFILE_RESET)
+        Profiler::reset();
 }
+#endif
@@ -0,0 +1,94 @@
+/*
+    Description: Generates the byte stream of an LSA08 in UART mode 1, for testing the LFR_UART reader.
+    Each byte is one reading: bit i is set if sensor i is over the line. A line of the given width
+    weaves across the array, and every so often a cross-section covers the whole array.
+    The stream goes to stdout; send it to RX1 of the bot through a USB-serial adapter, or replay it in
+    the simulator with -lsa08 FILE.
+
+    Build: g++ -std=c++11 tools/lsa08_stream.cpp -o lsa08_stream
+    Usage: lsa08_stream [-n READINGS] [-weave PITCHES] [-period READINGS] [-width PITCHES]
+                        [-cross EVERY] [-hold READINGS] [-text] > stream.bin
+           stty -F /dev/ttyUSB0 115200 raw && lsa08_stream > /dev/ttyUSB0
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#define SENSORS 8
+
+
+/**
+ * Reading of the array for a line centred at the given position
+ * @param double centre Position of the line; in sensor pitches, sensor 0 at 0
+ * @param double width  Line width; in sensor pitches
+ * @return int packed   Bit i set if sensor i is over the line
+ */
+static int reading(double centre, double width) {
+    int packed = 0;
+    for (int i = 0; i < SENSORS; i++)
+        if (fabs(i - centre) <= width / 2)
+            packed |= 1 << i;
+    return packed;
+}
+
+int main(int argc, char *argv[]) {
+    long readings = 11520; // One second at 115200 baud
+    double weave = 2,      // Amplitude of the weave
+           period = 2000,  // Readings per weave
+           width = 2.4;    // 30 mm line on a 12.5 mm pitch
+    long cross = 5000,     // Readings between cross-sections; 0 for none
+         hold = 200;       // Readings a cross-section lasts
+    bool text = false;     // One reading per line in binary digits, instead of raw bytes
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            readings = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-weave") && i + 1 < argc)
+            weave = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-period") && i + 1 < argc)
+            period = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-width") && i + 1 < argc)
+            width = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-cross") && i + 1 < argc)
+            cross = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-hold") && i + 1 < argc)
+            hold = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-text"))
+            text = true;
+        else {
+            fprintf(stderr, "Usage: %s [-n READINGS] [-weave PITCHES] [-period READINGS] [-width PITCHES] "
+                            "[-cross EVERY] [-hold READINGS] [-text]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (period <= 0) {
+        fprintf(stderr, "%s: period must be positive\n", argv[0]);
+        return 2;
+    }
+
+    long crossings = 0;
+    for (long t = 0; t < readings; t++) {
+        int packed;
+        if (cross && t % cross >= cross - hold) {
+            packed = (1 << SENSORS) - 1;
+            if (t % cross == cross - hold)
+                crossings++;
+        }
+        else
+            packed = reading((SENSORS - 1) / 2.0 + weave * sin(2 * M_PI * t / period), width);
+
+        if (text) {
+            for (int i = SENSORS - 1; i >= 0; i--)
+                putchar(packed >> i & 1 ? '1' : '0');
+            putchar('\n');
+        }
+        else
+            putchar(packed);
+    }
+
+    fprintf(stderr, "%ld readings, %ld cross-sections\n", readings, crossings);
+    return 0;
+}
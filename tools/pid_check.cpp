@@ -0,0 +1,57 @@
+/*
+    Description: Host check of the fixed-point PIDController.
+    Without integral action the output must be odd in the error: calcOutput(-e) == -calcOutput(e),
+    so the bot steers as hard to one side as to the other. Checked for a range of gains and errors,
+    for both the Q8.8 and the Q16.16 controller. Prints the first mismatch and exits with 1.
+
+    Build: g++ -std=c++11 -I lib/PIDController tools/pid_check.cpp -o pid_check
+    Usage: pid_check
+*/
+
+#include <stdio.h>
+#include <PIDController.h>
+
+
+#define MAX_ERROR 64 // Errors checked: 1 - MAX_ERROR, which covers the finest deviation of the IR array
+
+
+/**
+ * Compares the output for +e and -e over the error range, from a fresh controller each time
+ * @param float kP, kD  Gains; kI is 0
+ * @return int failures
+ */
+template <class PID>
+static int checkOdd(const char *name, float kP, float kD) {
+    for (int e = 1; e <= MAX_ERROR; e++) {
+        PID up(kP, 0, kD), down(kP, 0, kD);
+        int pos = up.calcOutput(e), neg = down.calcOutput(-e);
+        if (neg != -pos) {
+            printf("%s kP %g kD %g: calcOutput(%d) = %d, calcOutput(%d) = %d\n", name, kP, kD, e, pos, -e, neg);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main() {
+    const float gains[][2] = {
+        // kP, kD
+        {13, 0},
+        {0.3f, 0},
+        {11, 8},
+        {1.5f, 0.7f},
+        {0.05f, 2.5f},
+        {127, 0}
+    };
+    int failures = 0;
+
+    for (unsigned i = 0; i < sizeof(gains) / sizeof(*gains); i++) {
+        failures += checkOdd<PIDControllerQ8_8>("Q8.8", gains[i][0], gains[i][1]);
+        failures += checkOdd<PIDControllerQ16_16>("Q16.16", gains[i][0], gains[i][1]);
+    }
+
+    if (failures)
+        return 1;
+    printf("PID output is symmetric in the error\n");
+    return 0;
+}
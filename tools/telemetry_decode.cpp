@@ -0,0 +1,126 @@
+/*
+    Description: Decodes the telemetry stream of the bot into CSV.
+    Reads COBS frames (0 delimited) from a file or stdin, e.g. a capture of the serial port
+    or of the simulator's -telemetry output, and prints one line per record.
+    Frames of the wrong length are counted and skipped, so the capture may start mid-frame.
+    With -p the profile frames (sent when the host writes 'p') are printed instead of the records.
+
+    Build: g++ -std=c++11 -I lib/Telemetry tools/telemetry_decode.cpp -o telemetry_decode
+    Usage: telemetry_decode [-p] [FILE] > run.csv
+           stty -F /dev/ttyACM0 115200 raw && telemetry_decode /dev/ttyACM0
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <TelemetryRecord.h>
+
+
+#define MAX_FRAME 256
+
+
+/**
+ * Decodes one COBS frame in place
+ * @param uint8_t[] frame   Encoded bytes, without the delimiter
+ * @param size_t    n       Number of encoded bytes
+ * @return int size         Decoded size; -1 if the frame is malformed
+ */
+static int cobsDecode(uint8_t frame[], size_t n) {
+    size_t in = 0, out = 0;
+    while (in < n) {
+        uint8_t code = frame[in++];
+        if (!code || in + code - 1 > n)
+            return -1;
+        for (int i = 1; i < code; i++)
+            frame[out++] = frame[in++];
+        if (in < n)
+            frame[out++] = 0; // Each block but the last ends with a zero
+    }
+    return out;
+}
+
+static void printRecord(const TelemetryRecord &r) {
+    printf("%u,%u,%d,%d,%d,%d", (unsigned)r.tick, r.sensors, r.deviation, r.p, r.i, r.d);
+    for (int m = 0; m < 4; m++)
+        printf(",%u", r.pwm[m]);
+    for (int m = 0; m < 4; m++)
+        printf(",%d", (r.dir >> m) & 1);
+    printf(",%u\n", r.state);
+}
+
+static void printProfile(const ProfileRecord &r) {
+    static const char *sections[] = {"tick", "sensor", "pid", "motor", "period"};
+    if (r.section < sizeof(sections) / sizeof(*sections))
+        printf("%s", sections[r.section]);
+    else
+        printf("%u", r.section);
+    printf(",%u,%u,%u,%u", r.count, r.min, r.mean, r.max);
+    for (int b = 0; b < 16; b++)
+        printf(",%u", r.hist[b]);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    FILE *in = stdin;
+    bool profile = false;
+    int arg = 1;
+    if (arg < argc && !strcmp(argv[arg], "-p")) {
+        profile = true;
+        arg++;
+    }
+    if (argc - arg > 1) {
+        fprintf(stderr, "Usage: %s [-p] [FILE]\n", argv[0]);
+        return 2;
+    }
+    if (arg < argc && !(in = fopen(argv[arg], "rb"))) {
+        perror(argv[arg]);
+        return 1;
+    }
+
+    if (profile) {
+        printf("section,count,min,mean,max");
+        for (int b = 0; b < 16; b++)
+            printf(",%u+", b ? 1u << b : 0); // Lower bound of each bucket, in cycles
+        printf("\n");
+    }
+    else
+        printf("tick,sensors,deviation,p,i,d,pwm0,pwm1,pwm2,pwm3,dir0,dir1,dir2,dir3,state\n");
+
+    uint8_t frame[MAX_FRAME];
+    size_t n = 0;
+    bool overrun = false;
+    long records = 0, bad = 0;
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        if (c) {
+            if (n < MAX_FRAME)
+                frame[n++] = c;
+            else
+                overrun = true;
+            continue;
+        }
+
+        if (n) { // Empty frames are idle delimiters
+            int size = overrun ? -1 : cobsDecode(frame, n);
+            if (size == (int)sizeof(TelemetryRecord)) {
+                TelemetryRecord r;
+                memcpy(&r, frame, sizeof(r)); // The AVR and x86/ARM hosts are both little-endian
+                if (!profile)
+                    printRecord(r);
+                records++;
+            }
+            else if (size == (int)sizeof(ProfileRecord)) {
+                ProfileRecord r;
+                memcpy(&r, frame, sizeof(r));
+                if (profile)
+                    printProfile(r);
+            }
+            else
+                bad++;
+        }
+        n = 0;
+        overrun = false;
+    }
+
+    fprintf(stderr, "%ld records, %ld bad frames\n", records, bad);
+    return 0;
+}